@@ -0,0 +1,1003 @@
+#include "../src/header.h"
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Offline benchmarks over a synthetic dump. Every case reports throughput and
+// latency percentiles so runs can be compared between commits:
+//
+//   bench [-n pages] [-i iterations] [-s seed] [-g graph] [case filter]
+//
+// -g points the cases that can use it at a real graph as well, e.g.
+// inputs/graph.bin
+
+struct BenchContext {
+  struct SynthDumpOptions dump_options;
+  struct BuildOptions build_options;
+  uint32_t iterations;
+  const char* graph_path;
+  char* dump;
+  uint64_t dump_length;
+  FILE* dump_file;
+};
+
+struct BenchSamples {
+  uint64_t* ns;
+  uint32_t length;
+  uint32_t capacity;
+};
+
+static uint64_t now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static struct BenchSamples samples_init(uint32_t capacity) {
+  return (struct BenchSamples) {
+      .ns = malloc(capacity * sizeof(uint64_t)),
+      .length = 0,
+      .capacity = capacity,
+  };
+}
+
+static void samples_push(struct BenchSamples* samples, uint64_t ns) {
+  if (samples->length == samples->capacity) {
+    samples->capacity *= 2;
+    samples->ns = realloc(samples->ns, samples->capacity * sizeof(uint64_t));
+  }
+  samples->ns[samples->length++] = ns;
+}
+
+static int compare_u64(const void* a, const void* b) {
+  uint64_t x = *(const uint64_t*) a;
+  uint64_t y = *(const uint64_t*) b;
+  return (x > y) - (x < y);
+}
+
+// Nearest rank percentile, samples must be sorted
+static uint64_t percentile(struct BenchSamples* samples, double p) {
+  uint32_t rank = (uint32_t) (p / 100.0 * samples->length + 0.5);
+  if (rank == 0) {
+    rank = 1;
+  }
+  if (rank > samples->length) {
+    rank = samples->length;
+  }
+  return samples->ns[rank - 1];
+}
+
+// Prints one result row. Each sample covers `units_per_sample` units of work
+// (bytes or operations) which is what the throughput is reported in.
+static void report(const char* name, struct BenchSamples* samples,
+                   double units_per_sample, const char* unit) {
+  qsort(samples->ns, samples->length, sizeof(uint64_t), compare_u64);
+  uint64_t total = 0;
+  for (uint32_t i = 0; i < samples->length; i++) {
+    total += samples->ns[i];
+  }
+  double throughput =
+      units_per_sample * samples->length / ((double) total / 1e9);
+  printf("%-28s %8u %12.2f %-6s %10.3f %10.3f %10.3f %10.3f\n", name,
+         samples->length, throughput / 1e6, unit,
+         percentile(samples, 50) / 1e3, percentile(samples, 90) / 1e3,
+         percentile(samples, 99) / 1e3,
+         samples->ns[samples->length - 1] / 1e3);
+  free(samples->ns);
+}
+
+// ====== Cases ======
+
+static void bench_parse_buffer(struct BenchContext* ctx) {
+  struct BenchSamples samples = samples_init(ctx->iterations);
+  for (uint32_t i = 0; i < ctx->iterations; i++) {
+    struct Interner interner = interner_init(1 << 20);
+    struct VecEdge edges = vec_edge_init(1 << 16);
+    struct Str str = {.data = ctx->dump, .length = ctx->dump_length};
+    uint32_t from_id = UINT32_MAX;
+
+    uint64_t start = now_ns();
+    parse_buffer(&str, &interner, &edges, &from_id);
+    samples_push(&samples, now_ns() - start);
+
+    interner_destroy(&interner);
+    free(edges.data);
+  }
+  report("parse_buffer", &samples, ctx->dump_length, "MB/s");
+}
+
+#define INTERN_BATCH 1024
+
+static void bench_intern_from_cstr(struct BenchContext* ctx) {
+  // Replay the link targets of the dump, which gives the same Zipf shaped mix
+  // of hits and misses the parser produces
+  struct Interner reference = interner_init(1 << 20);
+  struct VecEdge edges = vec_edge_init(1 << 16);
+  struct Str str = {.data = ctx->dump, .length = ctx->dump_length};
+  uint32_t from_id = UINT32_MAX;
+  parse_buffer(&str, &reference, &edges, &from_id);
+
+  struct BenchSamples samples = samples_init(1024);
+  for (uint32_t i = 0; i < ctx->iterations; i++) {
+    struct Interner interner = interner_init(1 << 20);
+    for (uint32_t e = 0; e + INTERN_BATCH <= edges.length; e += INTERN_BATCH) {
+      uint64_t start = now_ns();
+      for (uint32_t j = e; j < e + INTERN_BATCH; j++) {
+        struct Slice slice = reference.strs.data[edges.data[j].to];
+        intern_from_cstr(&interner, arena_get_slice(&reference.arena, slice),
+                         slice.length);
+      }
+      samples_push(&samples, (now_ns() - start) / INTERN_BATCH);
+    }
+    interner_destroy(&interner);
+  }
+  if (samples.length == 0) {
+    printf("%-28s skipped, dump has fewer than %u links\n", "intern_from_cstr",
+           INTERN_BATCH);
+    free(samples.ns);
+  } else {
+    report("intern_from_cstr", &samples, 1, "Mop/s");
+  }
+
+  interner_destroy(&reference);
+  free(edges.data);
+}
+
+struct ConcurrentInternWorker {
+  struct ConcurrentInterner* interner;
+  struct Interner* reference;
+  struct VecEdge* edges;
+  uint32_t start;
+  uint32_t end;
+  struct BenchSamples samples;
+};
+
+static void* concurrent_intern_worker_run(void* arg) {
+  struct ConcurrentInternWorker* worker = arg;
+  struct InternerLocal local = interner_local_init(worker->interner);
+  for (uint32_t e = worker->start; e + INTERN_BATCH <= worker->end;
+       e += INTERN_BATCH) {
+    uint64_t start = now_ns();
+    for (uint32_t j = e; j < e + INTERN_BATCH; j++) {
+      struct Slice slice =
+          worker->reference->strs.data[worker->edges->data[j].to];
+      concurrent_intern(&local,
+                        arena_get_slice(&worker->reference->arena, slice),
+                        slice.length);
+    }
+    samples_push(&worker->samples, (now_ns() - start) / INTERN_BATCH);
+  }
+  return NULL;
+}
+
+#define MAX_BENCH_THREADS 8
+
+// Splits the link target stream between 1..MAX_BENCH_THREADS threads, the
+// throughput column is for all threads together
+static void bench_concurrent_intern(struct BenchContext* ctx) {
+  struct Interner reference = interner_init(1 << 20);
+  struct VecEdge edges = vec_edge_init(1 << 16);
+  struct Str str = {.data = ctx->dump, .length = ctx->dump_length};
+  uint32_t from_id = UINT32_MAX;
+  parse_buffer(&str, &reference, &edges, &from_id);
+
+  for (uint32_t threads = 1; threads <= MAX_BENCH_THREADS; threads *= 2) {
+    struct BenchSamples samples = samples_init(1024);
+    uint64_t elapsed = 0;
+    for (uint32_t i = 0; i < ctx->iterations; i++) {
+      struct ConcurrentInterner* interner = concurrent_interner_init(1 << 16);
+      struct ConcurrentInternWorker workers[MAX_BENCH_THREADS];
+      pthread_t handles[MAX_BENCH_THREADS];
+      uint64_t start = now_ns();
+      for (uint32_t t = 0; t < threads; t++) {
+        workers[t] = (struct ConcurrentInternWorker) {
+            .interner = interner,
+            .reference = &reference,
+            .edges = &edges,
+            .start = (uint64_t) edges.length * t / threads,
+            .end = (uint64_t) edges.length * (t + 1) / threads,
+            .samples = samples_init(256),
+        };
+        pthread_create(&handles[t], NULL, concurrent_intern_worker_run,
+                       &workers[t]);
+      }
+      for (uint32_t t = 0; t < threads; t++) {
+        pthread_join(handles[t], NULL);
+      }
+      elapsed += now_ns() - start;
+      for (uint32_t t = 0; t < threads; t++) {
+        for (uint32_t j = 0; j < workers[t].samples.length; j++) {
+          samples_push(&samples, workers[t].samples.ns[j]);
+        }
+        free(workers[t].samples.ns);
+      }
+      concurrent_interner_destroy(interner);
+    }
+
+    char name[64];
+    snprintf(name, sizeof(name), "concurrent_intern/%u", threads);
+    if (samples.length == 0) {
+      free(samples.ns);
+      continue;
+    }
+    uint32_t sample_count = samples.length;
+    report(name, &samples, 1, "Mop/s");
+    printf("%-28s %.2f Mop/s wall clock\n", "",
+           (double) sample_count * INTERN_BATCH / (elapsed / 1e3));
+  }
+
+  interner_destroy(&reference);
+  free(edges.data);
+}
+
+static void bench_build_graph_inner(struct BenchContext* ctx) {
+  struct BenchSamples samples = samples_init(ctx->iterations);
+  for (uint32_t i = 0; i < ctx->iterations; i++) {
+    struct Interner interner = interner_init(1 << 20);
+    struct VecEdge edges = vec_edge_init(1 << 20);
+    fseek(ctx->dump_file, 0, SEEK_SET);
+
+    uint64_t start = now_ns();
+    build_graph_inner(ctx->dump_file, BUFF_SIZE, &interner, &edges,
+                      "bench_graph.bin", &ctx->build_options);
+    samples_push(&samples, now_ns() - start);
+
+    interner_destroy(&interner);
+    free(edges.data);
+  }
+  report("build_graph_inner", &samples, ctx->dump_length, "MB/s");
+}
+
+// Builds the dump into a graph file and maps it, returns 0 on success
+static int open_bench_graph(struct BenchContext* ctx, struct Graph* graph) {
+  struct Interner interner = interner_init(1 << 20);
+  struct VecEdge edges = vec_edge_init(1 << 20);
+  fseek(ctx->dump_file, 0, SEEK_SET);
+  int result = build_graph_inner(ctx->dump_file, BUFF_SIZE, &interner, &edges,
+                                 "bench_graph.bin", &ctx->build_options);
+  interner_destroy(&interner);
+  free(edges.data);
+  if (result != 0) {
+    return result;
+  }
+  return graph_open(graph, "bench_graph.bin");
+}
+
+static uint64_t xorshift64(uint64_t* state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 7;
+  *state ^= *state << 17;
+  return *state;
+}
+
+static void bench_titles(struct BenchContext* ctx, const char* name,
+                         enum TitleEncoding encoding) {
+  ctx->build_options.title_encoding = encoding;
+  struct Graph graph;
+  int result = open_bench_graph(ctx, &graph);
+  ctx->build_options = build_options_default();
+  if (result != 0) {
+    return;
+  }
+
+  char scratch[TITLE_MAX_LENGTH];
+  uint64_t rng = ctx->dump_options.seed | 1;
+  uint64_t total_length = 0;
+  struct BenchSamples samples = samples_init(1024);
+  for (uint32_t i = 0; i < ctx->iterations * 64; i++) {
+    uint64_t start = now_ns();
+    for (uint32_t j = 0; j < INTERN_BATCH; j++) {
+      uint32_t id = xorshift64(&rng) % graph.node_count;
+      total_length += interner_view_get(&graph.titles, id, scratch).length;
+    }
+    samples_push(&samples, (now_ns() - start) / INTERN_BATCH);
+  }
+  report(name, &samples, 1, "Mop/s");
+  printf("%-28s %lu bytes\n", "  string table",
+         (unsigned long) (graph.header->sections[GRAPH_SECTION_TITLE_OFFSETS]
+                              .length +
+                          graph.header->sections[GRAPH_SECTION_TITLE_BYTES]
+                              .length));
+  log_trace("total title length %lu\n", (unsigned long) total_length);
+  graph_close(&graph);
+}
+
+static void bench_interner_view_get(struct BenchContext* ctx) {
+  bench_titles(ctx, "interner_view_get", TITLE_ENCODING_PLAIN);
+}
+
+static void bench_interner_view_get_fc(struct BenchContext* ctx) {
+  bench_titles(ctx, "interner_view_get_fc", TITLE_ENCODING_FRONT_CODED);
+}
+
+static void bench_solver_query(struct BenchContext* ctx) {
+  struct Graph graph;
+  if (open_bench_graph(ctx, &graph) != 0) {
+    return;
+  }
+
+  struct SearchState state = search_state_init(&graph);
+  uint32_t path[SEARCH_MAX_PATH];
+  uint64_t rng = ctx->dump_options.seed | 1;
+  uint32_t rejected = 0;
+  uint32_t unreachable = 0;
+  struct BenchSamples samples = samples_init(1024);
+  for (uint32_t i = 0; i < ctx->iterations * 100; i++) {
+    uint32_t source = xorshift64(&rng) % graph.node_count;
+    uint32_t target = xorshift64(&rng) % graph.node_count;
+    uint64_t start = now_ns();
+    uint32_t length = search_shortest_path(&graph, &state, source, target, path);
+    samples_push(&samples, now_ns() - start);
+    if (length == 0) {
+      unreachable++;
+      rejected += state.nodes_visited == 0;
+    }
+  }
+  report("solver_query", &samples, 1, "Mq/s");
+  printf("%-28s %u unreachable, %u rejected by the SCC index\n", "",
+         unreachable, rejected);
+  search_state_destroy(&state);
+  graph_close(&graph);
+}
+
+// Builds the dump with each link limit, then times random queries on the
+// smaller graphs. Pages past their limit are only scanned for </text>.
+static void bench_link_limits(struct BenchContext* ctx) {
+  struct {
+    const char* name;
+    struct LinkLimits limits;
+  } configs[] = {
+      {"all", {0, 0}},
+      {"lead", {0, 1}},
+      {"first20", {20, 0}},
+      {"lead_first20", {20, 1}},
+  };
+  for (size_t c = 0; c < sizeof(configs) / sizeof(configs[0]); c++) {
+    ctx->build_options.link_limits = configs[c].limits;
+    struct BenchSamples build = samples_init(ctx->iterations);
+    for (uint32_t i = 0; i < ctx->iterations; i++) {
+      struct Interner interner = interner_init(1 << 20);
+      struct VecEdge edges = vec_edge_init(1 << 20);
+      fseek(ctx->dump_file, 0, SEEK_SET);
+      uint64_t start = now_ns();
+      build_graph_inner(ctx->dump_file, BUFF_SIZE, &interner, &edges,
+                        "bench_graph.bin", &ctx->build_options);
+      samples_push(&build, now_ns() - start);
+      interner_destroy(&interner);
+      free(edges.data);
+    }
+    ctx->build_options = build_options_default();
+    struct Graph graph;
+    if (graph_open(&graph, "bench_graph.bin") != 0) {
+      free(build.ns);
+      return;
+    }
+
+    struct SearchState state = search_state_init(&graph);
+    uint32_t path[SEARCH_MAX_PATH];
+    uint64_t rng = ctx->dump_options.seed | 1;
+    uint64_t visited = 0;
+    struct BenchSamples queries = samples_init(1024);
+    for (uint32_t i = 0; i < ctx->iterations * 100; i++) {
+      uint32_t source = xorshift64(&rng) % graph.node_count;
+      uint32_t target = xorshift64(&rng) % graph.node_count;
+      uint64_t start = now_ns();
+      search_shortest_path(&graph, &state, source, target, path);
+      samples_push(&queries, now_ns() - start);
+      visited += state.nodes_visited;
+    }
+    char name[64];
+    snprintf(name, sizeof(name), "link_limits/%s/build", configs[c].name);
+    report(name, &build, ctx->dump_length, "MB/s");
+    snprintf(name, sizeof(name), "link_limits/%s/query", configs[c].name);
+    report(name, &queries, 1, "Mq/s");
+    printf("%-28s %u nodes, %u edges, %.0f nodes visited per query\n", "",
+           graph.node_count, graph.edge_count,
+           (double) visited / (ctx->iterations * 100));
+    search_state_destroy(&state);
+    graph_close(&graph);
+  }
+}
+
+// The same random queries without constraints, then with lists and years
+// banned and a hop limit, which should cost about the same per visited node
+static void bench_constrained_query(struct BenchContext* ctx) {
+  struct Graph graph;
+  if (open_bench_graph(ctx, &graph) != 0) {
+    return;
+  }
+  struct NodeMaskSpec specs[2];
+  node_mask_spec_parse(&specs[0], "lists=title:List of *");
+  node_mask_spec_parse(&specs[1], "years=title:[0-9]*");
+  struct NodeMasks masks;
+  if (node_masks_build(&graph, "bench_masks.bin", specs, 2) != 0 ||
+      node_masks_open(&masks, "bench_masks.bin", &graph) != 0) {
+    graph_close(&graph);
+    return;
+  }
+  uint64_t* banned = calloc(masks.words, sizeof(uint64_t));
+  node_masks_compile(&masks, "lists|years", banned);
+
+  struct SearchState state = search_state_init(&graph);
+  uint32_t path[SEARCH_MAX_PATH];
+  for (int constrained = 0; constrained < 2; constrained++) {
+    struct SearchConstraints constraints = search_constraints_none();
+    if (constrained) {
+      constraints.banned = banned;
+      constraints.max_hops = 6;
+    }
+    search_state_constrain(&state, &graph, &constraints);
+    uint64_t rng = ctx->dump_options.seed | 1;
+    uint64_t nodes = 0;
+    uint64_t total_ns = 0;
+    struct BenchSamples samples = samples_init(1024);
+    for (uint32_t i = 0; i < ctx->iterations * 100; i++) {
+      uint32_t source = xorshift64(&rng) % graph.node_count;
+      uint32_t target = xorshift64(&rng) % graph.node_count;
+      uint64_t start = now_ns();
+      search_shortest_path(&graph, &state, source, target, path);
+      uint64_t ns = now_ns() - start;
+      samples_push(&samples, ns);
+      nodes += state.nodes_visited;
+      total_ns += ns;
+    }
+    report(constrained ? "constrained_query" : "unconstrained_query",
+           &samples, 1, "Mq/s");
+    printf("%-28s %.1f M visited nodes per second\n", "",
+           nodes / (total_ns / 1e9) / 1e6);
+  }
+  free(banned);
+  search_state_destroy(&state);
+  node_masks_close(&masks);
+  graph_close(&graph);
+}
+
+static void bench_label_query(struct BenchContext* ctx) {
+  struct Graph graph;
+  if (open_bench_graph(ctx, &graph) != 0) {
+    return;
+  }
+
+  struct BenchSamples build_samples = samples_init(ctx->iterations);
+  for (uint32_t i = 0; i < ctx->iterations; i++) {
+    uint64_t start = now_ns();
+    label_index_build(&graph, "bench_labels.bin", 2);
+    samples_push(&build_samples, now_ns() - start);
+  }
+  report("label_index_build", &build_samples, graph.node_count, "Mn/s");
+
+  struct LabelIndex labels;
+  if (label_index_open(&labels, "bench_labels.bin", &graph) != 0) {
+    graph_close(&graph);
+    return;
+  }
+  printf("%-28s %lu entries, %.1f per node, %lu bytes\n", "  label index",
+         (unsigned long) (labels.header->out_entries +
+                          labels.header->in_entries),
+         (double) (labels.header->out_entries + labels.header->in_entries) /
+             graph.node_count,
+         (unsigned long) labels.map_length);
+
+  uint32_t path[SEARCH_MAX_PATH];
+  uint64_t rng = ctx->dump_options.seed | 1;
+  struct BenchSamples distance_samples = samples_init(1024);
+  struct BenchSamples path_samples = samples_init(1024);
+  for (uint32_t i = 0; i < ctx->iterations * 100; i++) {
+    uint32_t source = xorshift64(&rng) % graph.node_count;
+    uint32_t target = xorshift64(&rng) % graph.node_count;
+    uint64_t start = now_ns();
+    label_distance(&labels, source, target);
+    samples_push(&distance_samples, now_ns() - start);
+    start = now_ns();
+    label_shortest_path(&graph, &labels, source, target, path);
+    samples_push(&path_samples, now_ns() - start);
+  }
+  report("label_distance", &distance_samples, 1, "Mq/s");
+  report("label_shortest_path", &path_samples, 1, "Mq/s");
+
+  label_index_close(&labels);
+  graph_close(&graph);
+}
+
+// Query latency as the shard count grows, for both partitioners and
+// transports. One process per shard, so on fewer cores than shards this
+// mostly measures the message round trips per BFS level.
+static void bench_distributed_query(struct BenchContext* ctx) {
+  struct Graph graph;
+  if (open_bench_graph(ctx, &graph) != 0) {
+    return;
+  }
+  static const char* partition_names[] = {"range", "greedy"};
+  static const char* transport_names[] = {"socket", "shm"};
+  uint32_t path[SEARCH_MAX_PATH];
+
+  for (uint32_t kind = PARTITION_RANGE; kind <= PARTITION_GREEDY; kind++) {
+    for (uint32_t shards = 1; shards <= 8; shards *= 2) {
+      if (partition_graph(&graph, "bench_graph.shard", shards, kind) != 0) {
+        graph_close(&graph);
+        return;
+      }
+      for (uint32_t transport = TRANSPORT_UNIX_SOCKET;
+           transport <= TRANSPORT_SHARED_MEMORY; transport++) {
+        struct DistributedSearch search;
+        if (distributed_search_init(&search, "bench_graph.shard", shards,
+                                    transport) != 0) {
+          graph_close(&graph);
+          return;
+        }
+        uint64_t rng = ctx->dump_options.seed | 1;
+        uint64_t bytes = 0;
+        struct BenchSamples samples = samples_init(1024);
+        for (uint32_t i = 0; i < ctx->iterations * 20; i++) {
+          uint32_t source = xorshift64(&rng) % graph.node_count;
+          uint32_t target = xorshift64(&rng) % graph.node_count;
+          uint64_t start = now_ns();
+          distributed_shortest_path(&search, source, target, path);
+          samples_push(&samples, now_ns() - start);
+          bytes += search.bytes_moved;
+        }
+        char name[64];
+        snprintf(name, sizeof(name), "distributed/%s/%u/%s",
+                 partition_names[kind], shards, transport_names[transport]);
+        uint32_t queries = samples.length;
+        report(name, &samples, 1, "Mq/s");
+        printf("%-28s %.1f KB moved per query\n", "",
+               (double) bytes / queries / 1024);
+        distributed_search_destroy(&search);
+      }
+    }
+  }
+  graph_close(&graph);
+}
+
+// Cumulative weights of a Zipf distribution over count ranks
+static double* zipf_cdf(uint32_t count, double exponent) {
+  double* cdf = malloc(count * sizeof(double));
+  double total = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    total += 1 / pow(i + 1, exponent);
+    cdf[i] = total;
+  }
+  for (uint32_t i = 0; i < count; i++) {
+    cdf[i] /= total;
+  }
+  return cdf;
+}
+
+static uint32_t zipf_sample(const double* cdf, uint32_t count,
+                            uint64_t* rng) {
+  double u = (xorshift64(rng) >> 11) * (1.0 / (1ULL << 53));
+  uint32_t low = 0;
+  uint32_t high = count - 1;
+  while (low < high) {
+    uint32_t mid = low + (high - low) / 2;
+    if (cdf[mid] < u) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low;
+}
+
+// Multi-source BFS throughput per lane width against one plain BFS per
+// source, in source-node pairs per second
+static void bench_msbfs(struct BenchContext* ctx) {
+  struct Graph graph;
+  if (open_bench_graph(ctx, &graph) != 0) {
+    return;
+  }
+  uint32_t sources[MSBFS_MAX_SOURCES];
+  uint64_t rng = ctx->dump_options.seed | 1;
+  for (uint32_t i = 0; i < MSBFS_MAX_SOURCES; i++) {
+    sources[i] = xorshift64(&rng) % graph.node_count;
+  }
+  struct MsBfsResult* result = malloc(sizeof(struct MsBfsResult));
+  uint64_t pairs = (uint64_t) MSBFS_MAX_SOURCES * graph.node_count;
+
+  uint32_t* queue = malloc(graph.node_count * sizeof(uint32_t));
+  uint8_t* seen = malloc(graph.node_count);
+  struct BenchSamples single = samples_init(ctx->iterations);
+  for (uint32_t it = 0; it < ctx->iterations; it++) {
+    uint64_t start = now_ns();
+    for (uint32_t i = 0; i < MSBFS_MAX_SOURCES; i++) {
+      memset(seen, 0, graph.node_count);
+      uint32_t head = 0;
+      uint32_t tail = 0;
+      seen[sources[i]] = 1;
+      queue[tail++] = sources[i];
+      while (head < tail) {
+        uint32_t node = queue[head++];
+        for (uint32_t e = graph.out_offsets[node];
+             e < graph.out_offsets[node + 1]; e++) {
+          uint32_t next = graph.out_targets[e];
+          if (!seen[next]) {
+            seen[next] = 1;
+            queue[tail++] = next;
+          }
+        }
+      }
+    }
+    samples_push(&single, now_ns() - start);
+  }
+  report("msbfs/single_bfs", &single, pairs, "Mp/s");
+  free(queue);
+  free(seen);
+
+  for (uint32_t lanes = 64; lanes <= MSBFS_MAX_SOURCES; lanes *= 2) {
+    struct MsBfs msbfs = msbfs_init(&graph, lanes, 1, 0);
+    struct BenchSamples samples = samples_init(ctx->iterations);
+    for (uint32_t it = 0; it < ctx->iterations; it++) {
+      uint64_t start = now_ns();
+      for (uint32_t batch = 0; batch < MSBFS_MAX_SOURCES; batch += lanes) {
+        msbfs_run(&msbfs, &sources[batch], lanes, result);
+      }
+      samples_push(&samples, now_ns() - start);
+    }
+    char name[32];
+    snprintf(name, sizeof(name), "msbfs/lanes_%u", lanes);
+    report(name, &samples, pairs, "Mp/s");
+    msbfs_destroy(&msbfs);
+  }
+  free(result);
+  graph_close(&graph);
+}
+
+#define POWER_LAW_NODES (1U << 24)
+#define POWER_LAW_MAX_DEGREE 20000
+
+// An in memory graph bigger than the last level cache with power law in and out
+// degrees, like the link graph. Ids are scattered so hubs aren't neighbours
+// in memory. One component, which is all search_shortest_path reads.
+static void power_law_graph(struct Graph* graph, uint64_t seed) {
+  uint32_t n = POWER_LAW_NODES;
+  uint32_t* offsets = malloc((n + 1) * sizeof(uint32_t));
+  uint64_t rng = seed | 1;
+  offsets[0] = 0;
+  for (uint32_t i = 0; i < n; i++) {
+    // Pareto with alpha 2, about 10 links on average
+    double u = (xorshift64(&rng) >> 11) * 0x1.0p-53 + 0x1.0p-54;
+    uint32_t degree = (uint32_t) (5 / sqrt(u));
+    if (degree > POWER_LAW_MAX_DEGREE) {
+      degree = POWER_LAW_MAX_DEGREE;
+    }
+    offsets[i + 1] = offsets[i] + degree;
+  }
+  uint32_t* targets = malloc((offsets[n] + 1) * sizeof(uint32_t));
+  for (uint32_t e = 0; e < offsets[n]; e++) {
+    // Skewed towards low ranks, then an odd multiplier permutes the ranks
+    double u = (xorshift64(&rng) >> 11) * 0x1.0p-53;
+    uint32_t rank = (uint32_t) (n * u * u * u);
+    targets[e] = (rank * 0x9e3779b1U) & (n - 1);
+  }
+  *graph = (struct Graph) {
+      .node_count = n,
+      .edge_count = offsets[n],
+      .out_offsets = offsets,
+      .out_targets = targets,
+      .component_count = 1,
+      .scc_ids = calloc(n, sizeof(uint32_t)),
+  };
+}
+
+static void power_law_graph_destroy(struct Graph* graph) {
+  free((void*) graph->out_offsets);
+  free((void*) graph->out_targets);
+  free((void*) graph->scc_ids);
+}
+
+#define PREFETCH_DISTANCES 5
+
+// The same random queries with each prefetch distance, 0 being the plain
+// kernel. Every query runs at all distances back to back, starting at a
+// different one each time, so drift between runs and whatever the previous
+// run left in cache fall evenly on every distance.
+static void bench_prefetch_graph(struct BenchContext* ctx, const char* name,
+                                 const struct Graph* graph) {
+  static const uint32_t distances[PREFETCH_DISTANCES] = {0, 2, 4, 8, 16};
+  struct SearchState state = search_state_init(graph);
+  uint32_t path[SEARCH_MAX_PATH];
+  // Most random pairs on a big graph visit a large part of it
+  uint32_t queries = ctx->iterations;
+  struct BenchSamples samples[PREFETCH_DISTANCES];
+  uint64_t nodes[PREFETCH_DISTANCES] = {0};
+  uint64_t total_ns[PREFETCH_DISTANCES] = {0};
+  for (uint32_t d = 0; d < PREFETCH_DISTANCES; d++) {
+    samples[d] = samples_init(queries);
+  }
+  uint64_t rng = ctx->dump_options.seed | 1;
+  for (uint32_t i = 0; i < queries; i++) {
+    uint32_t source = xorshift64(&rng) % graph->node_count;
+    uint32_t target = xorshift64(&rng) % graph->node_count;
+    for (uint32_t k = 0; k < PREFETCH_DISTANCES; k++) {
+      uint32_t d = (i + k) % PREFETCH_DISTANCES;
+      state.prefetch_distance = distances[d];
+      uint64_t start = now_ns();
+      search_shortest_path(graph, &state, source, target, path);
+      uint64_t ns = now_ns() - start;
+      samples_push(&samples[d], ns);
+      nodes[d] += state.nodes_visited;
+      total_ns[d] += ns;
+    }
+  }
+  double plain_rate = nodes[0] / (total_ns[0] / 1e9);
+  for (uint32_t d = 0; d < PREFETCH_DISTANCES; d++) {
+    char label[64];
+    snprintf(label, sizeof(label), "prefetch/%s/d%u", name, distances[d]);
+    report(label, &samples[d], 1, "Mq/s");
+    double rate = nodes[d] / (total_ns[d] / 1e9);
+    printf("%-28s %.2f M visited nodes per second, %+.1f%% vs d0\n", "",
+           rate / 1e6, 100.0 * (rate / plain_rate - 1));
+  }
+  search_state_destroy(&state);
+}
+
+static void bench_prefetch(struct BenchContext* ctx) {
+  struct Graph graph;
+  power_law_graph(&graph, ctx->dump_options.seed);
+  printf("%-28s %u nodes, %u edges\n", "  power law graph", graph.node_count,
+         graph.edge_count);
+  bench_prefetch_graph(ctx, "power_law", &graph);
+  power_law_graph_destroy(&graph);
+
+  if (ctx->graph_path != NULL) {
+    if (graph_open(&graph, ctx->graph_path) != 0) {
+      return;
+    }
+    bench_prefetch_graph(ctx, "graph", &graph);
+    graph_close(&graph);
+  }
+}
+
+// Skewed traffic: targets and sources both follow a Zipf distribution over a
+// shuffled order of the nodes, targets more steeply
+static void bench_query_cache(struct BenchContext* ctx) {
+  struct Graph graph;
+  if (open_bench_graph(ctx, &graph) != 0) {
+    return;
+  }
+  uint32_t n = graph.node_count;
+  uint32_t* order = malloc(n * sizeof(uint32_t));
+  uint64_t rng = ctx->dump_options.seed | 1;
+  for (uint32_t i = 0; i < n; i++) {
+    order[i] = i;
+  }
+  for (uint32_t i = n - 1; i > 0; i--) {
+    uint32_t j = xorshift64(&rng) % (i + 1);
+    uint32_t tmp = order[i];
+    order[i] = order[j];
+    order[j] = tmp;
+  }
+  double* target_cdf = zipf_cdf(n, 1.1);
+  double* source_cdf = zipf_cdf(n, 0.8);
+
+  struct SearchState state = search_state_init(&graph);
+  uint32_t path[SEARCH_MAX_PATH];
+  uint32_t queries = ctx->iterations * 2000;
+  for (int use_cache = 0; use_cache < 2; use_cache++) {
+    struct QueryCacheOptions options = query_cache_default_options();
+    // A few dozen trees, so the cold end of the distribution misses
+    options.tree_budget_bytes = 32 * (size_t) n * 5;
+    options.pair_budget_bytes = 1 << 20;
+    struct QueryCache* cache =
+        use_cache ? query_cache_init(&graph, &options) : NULL;
+    struct BenchSamples samples = samples_init(queries);
+    rng = ctx->dump_options.seed | 1;
+    for (uint32_t i = 0; i < queries; i++) {
+      uint32_t source = order[zipf_sample(source_cdf, n, &rng)];
+      uint32_t target = order[zipf_sample(target_cdf, n, &rng)];
+      uint64_t start = now_ns();
+      uint32_t length = QUERY_CACHE_MISS;
+      if (cache != NULL) {
+        length = query_cache_lookup(cache, source, target, path);
+      }
+      if (length == QUERY_CACHE_MISS) {
+        length = search_shortest_path(&graph, &state, source, target, path);
+        if (cache != NULL) {
+          query_cache_insert(cache, source, target, path, length);
+        }
+      }
+      samples_push(&samples, now_ns() - start);
+      // Between queries, like the solver, so the BFS isn't in any sample
+      if (cache != NULL) {
+        query_cache_build_trees(cache);
+      }
+    }
+    report(use_cache ? "query_cache/zipf" : "query_cache/uncached", &samples,
+           1, "Mq/s");
+    if (cache != NULL) {
+      struct QueryCacheStats stats = query_cache_stats(cache);
+      printf("%-28s %.1f%% tree hits, %.1f%% pair hits, %lu trees built, "
+             "%lu KB in trees, %lu KB in pairs\n",
+             "", 100.0 * stats.tree_hits / stats.lookups,
+             100.0 * stats.pair_hits / stats.lookups,
+             (unsigned long) stats.trees_built,
+             (unsigned long) stats.tree_bytes >> 10,
+             (unsigned long) stats.pair_bytes >> 10);
+      query_cache_destroy(cache);
+    }
+  }
+  search_state_destroy(&state);
+  free(order);
+  free(target_cdf);
+  free(source_cdf);
+  graph_close(&graph);
+}
+
+// Drops the file from the page cache so the next open starts cold, as after a
+// restart. Only works for pages no other process has mapped.
+static void evict_page_cache(const char* path) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return;
+  }
+  fdatasync(fd);
+  posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+  close(fd);
+}
+
+struct StartupConfig {
+  const char* name;
+  struct GraphLoadOptions options;
+};
+
+// Time to ready and query latency straight after opening a cold graph file,
+// then the same queries again once everything they touch is resident
+static void bench_startup(struct BenchContext* ctx) {
+  struct Graph graph;
+  if (open_bench_graph(ctx, &graph) != 0) {
+    return;
+  }
+  uint32_t node_count = graph.node_count;
+  graph_close(&graph);
+
+  struct StartupConfig configs[] = {
+      {"mmap", {0, 0, GRAPH_HUGE_PAGES_NONE}},
+      {"populate", {1, 0, GRAPH_HUGE_PAGES_NONE}},
+      {"prefault4", {4, 0, GRAPH_HUGE_PAGES_NONE}},
+      {"prefault4_mlock", {4, 1, GRAPH_HUGE_PAGES_NONE}},
+      {"thp_copy", {4, 0, GRAPH_HUGE_PAGES_TRANSPARENT}},
+  };
+  uint32_t queries = ctx->iterations * 100;
+  uint32_t path[SEARCH_MAX_PATH];
+  for (uint32_t c = 0; c < sizeof(configs) / sizeof(configs[0]); c++) {
+    struct BenchSamples ready_samples = samples_init(ctx->iterations);
+    struct BenchSamples cold = samples_init(queries * ctx->iterations);
+    struct BenchSamples warm = samples_init(queries * ctx->iterations);
+    for (uint32_t i = 0; i < ctx->iterations; i++) {
+      evict_page_cache("bench_graph.bin");
+      uint64_t start = now_ns();
+      if (graph_open_with(&graph, "bench_graph.bin", &configs[c].options) !=
+          0) {
+        return;
+      }
+      struct SearchState state = search_state_init(&graph);
+      samples_push(&ready_samples, now_ns() - start);
+
+      for (uint32_t pass = 0; pass < 2; pass++) {
+        uint64_t rng = ctx->dump_options.seed | 1;
+        for (uint32_t q = 0; q < queries; q++) {
+          uint32_t source = xorshift64(&rng) % node_count;
+          uint32_t target = xorshift64(&rng) % node_count;
+          start = now_ns();
+          search_shortest_path(&graph, &state, source, target, path);
+          samples_push(pass == 0 ? &cold : &warm, now_ns() - start);
+        }
+      }
+      search_state_destroy(&state);
+      graph_close(&graph);
+    }
+
+    char name[64];
+    snprintf(name, sizeof(name), "startup/%s/ready", configs[c].name);
+    // Scaled so the throughput column is in opens per second
+    report(name, &ready_samples, 1e6, "open/s");
+    snprintf(name, sizeof(name), "startup/%s/cold", configs[c].name);
+    report(name, &cold, 1, "Mq/s");
+    snprintf(name, sizeof(name), "startup/%s/warm", configs[c].name);
+    report(name, &warm, 1, "Mq/s");
+  }
+}
+
+struct BenchCase {
+  const char* name;
+  void (*run)(struct BenchContext* ctx);
+};
+
+static struct BenchCase bench_cases[] = {
+    {"parse_buffer", bench_parse_buffer},
+    {"intern_from_cstr", bench_intern_from_cstr},
+    {"concurrent_intern", bench_concurrent_intern},
+    {"build_graph_inner", bench_build_graph_inner},
+    {"interner_view_get", bench_interner_view_get},
+    {"interner_view_get_fc", bench_interner_view_get_fc},
+    {"solver_query", bench_solver_query},
+    {"constrained", bench_constrained_query},
+    {"link_limits", bench_link_limits},
+    {"label", bench_label_query},
+    {"distributed", bench_distributed_query},
+    {"startup", bench_startup},
+    {"query_cache", bench_query_cache},
+    {"msbfs", bench_msbfs},
+    {"prefetch", bench_prefetch},
+    {NULL, NULL},
+};
+
+static void usage(const char* name) {
+  fprintf(stderr,
+          "usage: %s [-n pages] [-i iterations] [-s seed] [-g graph] "
+          "[filter]\n",
+          name);
+}
+
+int main(int argc, char* argv[]) {
+  set_log_level(LOG_LEVEL_ERROR);
+  struct BenchContext ctx = {
+      .dump_options = synth_dump_default_options(),
+      .build_options = build_options_default(),
+      .iterations = 10,
+  };
+
+  int opt;
+  while ((opt = getopt(argc, argv, "n:i:s:g:h")) != -1) {
+    switch (opt) {
+    case 'n':
+      ctx.dump_options.page_count = strtoul(optarg, NULL, 10);
+      break;
+    case 'i':
+      ctx.iterations = strtoul(optarg, NULL, 10);
+      break;
+    case 's':
+      ctx.dump_options.seed = strtoull(optarg, NULL, 10);
+      break;
+    case 'g':
+      ctx.graph_path = optarg;
+      break;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  const char* filter = optind < argc ? argv[optind] : NULL;
+  if (ctx.iterations == 0) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  ctx.dump_file = tmpfile();
+  if (ctx.dump_file == NULL ||
+      synth_dump_write(ctx.dump_file, &ctx.dump_options) != 0) {
+    perror("Failed to generate synthetic dump");
+    return 1;
+  }
+  fseek(ctx.dump_file, 0, SEEK_END);
+  ctx.dump_length = ftell(ctx.dump_file);
+  fseek(ctx.dump_file, 0, SEEK_SET);
+  ctx.dump = malloc(ctx.dump_length);
+  if (fread(ctx.dump, 1, ctx.dump_length, ctx.dump_file) != ctx.dump_length) {
+    perror("Failed to read synthetic dump");
+    return 1;
+  }
+
+  printf("synthetic dump: %u pages, %.2f MB, seed %lu\n",
+         ctx.dump_options.page_count, ctx.dump_length / 1e6,
+         (unsigned long) ctx.dump_options.seed);
+  printf("%-28s %8s %19s %10s %10s %10s %10s\n", "case", "samples",
+         "throughput", "p50 us", "p90 us", "p99 us", "max us");
+  for (struct BenchCase* c = bench_cases; c->name != NULL; c++) {
+    if (filter != NULL && strstr(c->name, filter) == NULL) {
+      continue;
+    }
+    c->run(&ctx);
+  }
+
+  free(ctx.dump);
+  fclose(ctx.dump_file);
+  return 0;
+}
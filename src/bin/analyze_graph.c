@@ -0,0 +1,191 @@
+#include "header.h"
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_NAMED_SOURCES 64
+
+static uint64_t now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void usage(const char* name) {
+  fprintf(stderr,
+          "usage: %s [-n sources] [-w lanes] [-t threads] [-s seed] [-r] "
+          "[-T title]... [-o output prefix] [graph]\n",
+          name);
+}
+
+static uint64_t xorshift64(uint64_t* state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 7;
+  *state ^= *state << 17;
+  return *state;
+}
+
+struct Analysis {
+  struct Graph graph;
+  FILE* eccentricities;
+  uint64_t histogram[SEARCH_MAX_PATH];
+  uint64_t reached_pairs;
+  uint32_t depth;
+};
+
+static void write_sources(struct Analysis* analysis, const uint32_t* sources,
+                          const struct MsBfsResult* result) {
+  char scratch[TITLE_MAX_LENGTH];
+  char far_scratch[TITLE_MAX_LENGTH];
+  for (uint32_t i = 0; i < result->source_count; i++) {
+    struct Str title =
+        interner_view_get(&analysis->graph.titles, sources[i], scratch);
+    struct Str far = interner_view_get(&analysis->graph.titles,
+                                       result->farthest[i], far_scratch);
+    fprintf(analysis->eccentricities, "%.*s\t%u\t%u\t%.3f\t%.*s\n",
+            (int) title.length, title.data, result->eccentricity[i],
+            result->reached[i],
+            (double) result->distance_sum[i] / result->reached[i],
+            (int) far.length, far.data);
+  }
+  for (uint32_t d = 0; d <= result->depth; d++) {
+    analysis->histogram[d] += result->histogram[d];
+    analysis->reached_pairs += result->histogram[d];
+  }
+  if (result->depth > analysis->depth) {
+    analysis->depth = result->depth;
+  }
+}
+
+static int write_histogram(struct Analysis* analysis, const char* path,
+                           uint64_t source_count) {
+  FILE* out = fopen(path, "w");
+  if (out == NULL) {
+    log_error("Failed to open %s for writing\n", path);
+    return 1;
+  }
+  fprintf(out, "distance\tpairs\n");
+  for (uint32_t d = 0; d <= analysis->depth; d++) {
+    fprintf(out, "%u\t%lu\n", d, analysis->histogram[d]);
+  }
+  fprintf(out, "unreachable\t%lu\n",
+          source_count * analysis->graph.node_count - analysis->reached_pairs);
+  return fclose(out) != 0;
+}
+
+int main(int argc, char* argv[]) {
+  set_log_level(LOG_LEVEL_INFO);
+  uint32_t source_count = 512;
+  uint32_t lanes = MSBFS_MAX_SOURCES;
+  uint32_t threads = 1;
+  uint64_t seed = 1;
+  int reverse = 0;
+  const char* named[MAX_NAMED_SOURCES];
+  uint32_t named_count = 0;
+  const char* prefix = "inputs/analysis";
+
+  int opt;
+  while ((opt = getopt(argc, argv, "n:w:t:s:rT:o:h")) != -1) {
+    switch (opt) {
+    case 'n':
+      source_count = strtoul(optarg, NULL, 10);
+      break;
+    case 'w':
+      lanes = strtoul(optarg, NULL, 10);
+      break;
+    case 't':
+      threads = strtoul(optarg, NULL, 10);
+      break;
+    case 's':
+      seed = strtoull(optarg, NULL, 10);
+      break;
+    case 'r':
+      reverse = 1;
+      break;
+    case 'T':
+      if (named_count < MAX_NAMED_SOURCES) {
+        named[named_count++] = optarg;
+      }
+      break;
+    case 'o':
+      prefix = optarg;
+      break;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  const char* graph_path = optind < argc ? argv[optind] : "inputs/graph.bin";
+  if (lanes == 0 || lanes > MSBFS_MAX_SOURCES) {
+    log_error("Lanes must be between 1 and %u\n", MSBFS_MAX_SOURCES);
+    return 1;
+  }
+
+  struct Analysis analysis = {0};
+  struct Graph* graph = &analysis.graph;
+  if (graph_open(graph, graph_path) != 0) {
+    return 1;
+  }
+
+  // Named titles first, e.g. -r -T Philosophy for how far every page is from
+  // it, then random samples
+  uint32_t* sources = malloc((named_count + source_count) * sizeof(uint32_t));
+  uint32_t total = 0;
+  for (uint32_t i = 0; i < named_count; i++) {
+    uint32_t id =
+        interner_view_find(&graph->titles, named[i], strlen(named[i]));
+    if (id == UINT32_MAX) {
+      log_error("Unknown title: %s\n", named[i]);
+      continue;
+    }
+    sources[total++] = id;
+  }
+  uint64_t rng = seed | 1;
+  for (uint32_t i = 0; i < source_count && graph->node_count > 0; i++) {
+    sources[total++] = xorshift64(&rng) % graph->node_count;
+  }
+
+  char path[1024];
+  snprintf(path, sizeof(path), "%s.eccentricity.tsv", prefix);
+  analysis.eccentricities = fopen(path, "w");
+  if (analysis.eccentricities == NULL) {
+    log_error("Failed to open %s for writing\n", path);
+    free(sources);
+    graph_close(graph);
+    return 1;
+  }
+  fprintf(analysis.eccentricities,
+          "source\teccentricity\treached\tmean_distance\tfarthest\n");
+
+  struct MsBfs msbfs = msbfs_init(graph, lanes, threads, reverse);
+  struct MsBfsResult* result = malloc(sizeof(struct MsBfsResult));
+  uint64_t start = now_ns();
+  int status = 0;
+  for (uint32_t batch = 0; batch < total && status == 0; batch += lanes) {
+    uint32_t count = total - batch < lanes ? total - batch : lanes;
+    status = msbfs_run(&msbfs, &sources[batch], count, result);
+    if (status == 0) {
+      write_sources(&analysis, &sources[batch], result);
+      print_progress(batch + count, total);
+    }
+  }
+  double seconds = (now_ns() - start) / 1e9;
+  log_info("\n%u sources in %.2f s, %.1f M source-node pairs per second\n",
+           total, seconds, analysis.reached_pairs / seconds / 1e6);
+
+  status |= fclose(analysis.eccentricities) != 0;
+  snprintf(path, sizeof(path), "%s.histogram.tsv", prefix);
+  if (status == 0) {
+    status = write_histogram(&analysis, path, total);
+  }
+  if (status == 0) {
+    log_info("Wrote %s.histogram.tsv and %s.eccentricity.tsv\n", prefix,
+             prefix);
+  }
+
+  free(result);
+  free(sources);
+  msbfs_destroy(&msbfs);
+  graph_close(graph);
+  return status;
+}
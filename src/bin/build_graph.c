@@ -1,6 +1,66 @@
 #include "header.h"
+#include <stdlib.h>
+#include <string.h>
 
-int main() {
+static void usage(const char* name) {
+  fprintf(stderr,
+          "usage: %s [--front-code] [--lead] [--max-links N] "
+          "[--output path] [--masks path]\n",
+          name);
+}
+
+int main(int argc, char* argv[]) {
   set_log_level(LOG_LEVEL_INFO);
-  return build_graph();
+  struct BuildOptions options = build_options_default();
+  const char* output_path = NULL;
+  const char* mask_path = NULL;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--front-code") == 0) {
+      options.title_encoding = TITLE_ENCODING_FRONT_CODED;
+    } else if (strcmp(argv[i], "--lead") == 0) {
+      options.link_limits.lead_only = 1;
+    } else if (strcmp(argv[i], "--max-links") == 0 && i + 1 < argc) {
+      options.link_limits.max_links = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+      output_path = argv[++i];
+    } else if (strcmp(argv[i], "--masks") == 0 && i + 1 < argc) {
+      mask_path = argv[++i];
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  // Limited graphs sit next to the full one by default, e.g.
+  // inputs/graph.lead.first20.bin, so the solver can load both
+  char variant_path[64];
+  const struct LinkLimits* limits = &options.link_limits;
+  if (output_path != NULL) {
+    options.output_path = output_path;
+  } else if (limits->lead_only || limits->max_links > 0) {
+    char first[24] = "";
+    if (limits->max_links > 0) {
+      snprintf(first, sizeof(first), ".first%u", limits->max_links);
+    }
+    snprintf(variant_path, sizeof(variant_path), "inputs/graph%s%s.bin",
+             limits->lead_only ? ".lead" : "", first);
+    options.output_path = variant_path;
+  }
+  if (build_graph(&options) != 0) {
+    return 1;
+  }
+  if (mask_path == NULL) {
+    return 0;
+  }
+
+  // The default masks, build_masks names others or rebuilds them later
+  struct NodeMaskSpec specs[MASK_MAX_COUNT];
+  uint32_t count = node_mask_default_specs(specs);
+  struct Graph graph;
+  if (graph_open(&graph, options.output_path) != 0) {
+    return 1;
+  }
+  int result = node_masks_build(&graph, mask_path, specs, count);
+  graph_close(&graph);
+  return result;
 }
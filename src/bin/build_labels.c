@@ -0,0 +1,29 @@
+#include "header.h"
+#include <unistd.h>
+
+int main(int argc, char* argv[]) {
+  set_log_level(LOG_LEVEL_INFO);
+  uint32_t threads = 2;
+  int opt;
+  while ((opt = getopt(argc, argv, "t:h")) != -1) {
+    switch (opt) {
+    case 't':
+      threads = strtoul(optarg, NULL, 10);
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-t threads] [graph] [labels]\n", argv[0]);
+      return 1;
+    }
+  }
+  const char* graph_path = optind < argc ? argv[optind] : "inputs/graph.bin";
+  const char* label_path =
+      optind + 1 < argc ? argv[optind + 1] : "inputs/labels.bin";
+
+  struct Graph graph;
+  if (graph_open(&graph, graph_path) != 0) {
+    return 1;
+  }
+  int result = label_index_build(&graph, label_path, threads);
+  graph_close(&graph);
+  return result;
+}
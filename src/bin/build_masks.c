@@ -0,0 +1,50 @@
+#include "header.h"
+#include <unistd.h>
+
+// Separate from build_graph so masks can be named on the command line and
+// rebuilt without parsing the dump again, build_graph --masks writes the
+// default ones right after the graph
+int main(int argc, char* argv[]) {
+  set_log_level(LOG_LEVEL_INFO);
+  const char* graph_path = "inputs/graph.bin";
+  const char* output_path = "inputs/masks.bin";
+  int opt;
+  while ((opt = getopt(argc, argv, "i:o:h")) != -1) {
+    switch (opt) {
+    case 'i':
+      graph_path = optarg;
+      break;
+    case 'o':
+      output_path = optarg;
+      break;
+    default:
+      fprintf(stderr,
+              "usage: %s [-i graph] [-o masks] "
+              "[name=title:GLOB | name=category:GLOB]...\n",
+              argv[0]);
+      return 1;
+    }
+  }
+  uint32_t count = argc - optind;
+  if (count > MASK_MAX_COUNT) {
+    log_error("At most %u masks per file\n", MASK_MAX_COUNT);
+    return 1;
+  }
+  struct NodeMaskSpec specs[MASK_MAX_COUNT];
+  for (uint32_t i = 0; i < count; i++) {
+    if (node_mask_spec_parse(&specs[i], argv[optind + i]) != 0) {
+      return 1;
+    }
+  }
+  if (count == 0) {
+    count = node_mask_default_specs(specs);
+  }
+
+  struct Graph graph;
+  if (graph_open(&graph, graph_path) != 0) {
+    return 1;
+  }
+  int result = node_masks_build(&graph, output_path, specs, count);
+  graph_close(&graph);
+  return result;
+}
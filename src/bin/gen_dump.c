@@ -0,0 +1,52 @@
+#include "header.h"
+#include <unistd.h>
+
+static void usage(const char* name) {
+  fprintf(stderr,
+          "usage: %s [-n pages] [-l mean_links] [-r red_link_pct] "
+          "[-t template_pct] [-s seed] [-o output]\n",
+          name);
+}
+
+int main(int argc, char* argv[]) {
+  set_log_level(LOG_LEVEL_INFO);
+  struct SynthDumpOptions options = synth_dump_default_options();
+  const char* output_path = "inputs/synthetic.xml";
+
+  int opt;
+  while ((opt = getopt(argc, argv, "n:l:r:t:s:o:h")) != -1) {
+    switch (opt) {
+    case 'n':
+      options.page_count = strtoul(optarg, NULL, 10);
+      break;
+    case 'l':
+      options.mean_links = strtoul(optarg, NULL, 10);
+      break;
+    case 'r':
+      options.red_link_pct = strtoul(optarg, NULL, 10);
+      break;
+    case 't':
+      options.template_pct = strtoul(optarg, NULL, 10);
+      break;
+    case 's':
+      options.seed = strtoull(optarg, NULL, 10);
+      break;
+    case 'o':
+      output_path = optarg;
+      break;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  FILE* out = fopen(output_path, "w");
+  if (out == NULL) {
+    perror("Failed to open output file");
+    return 1;
+  }
+  int result = synth_dump_write(out, &options);
+  fclose(out);
+  log_info("Wrote %u pages to %s\n", options.page_count, output_path);
+  return result;
+}
@@ -0,0 +1,34 @@
+#include "header.h"
+#include <unistd.h>
+
+int main(int argc, char* argv[]) {
+  set_log_level(LOG_LEVEL_INFO);
+  uint32_t shard_count = 4;
+  enum PartitionKind kind = PARTITION_RANGE;
+  int opt;
+  while ((opt = getopt(argc, argv, "n:gh")) != -1) {
+    switch (opt) {
+    case 'n':
+      shard_count = strtoul(optarg, NULL, 10);
+      break;
+    case 'g':
+      kind = PARTITION_GREEDY;
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-n shards] [-g] [graph] [prefix]\n",
+              argv[0]);
+      return 1;
+    }
+  }
+  const char* graph_path = optind < argc ? argv[optind] : "inputs/graph.bin";
+  const char* prefix =
+      optind + 1 < argc ? argv[optind + 1] : "inputs/graph.shard";
+
+  struct Graph graph;
+  if (graph_open(&graph, graph_path) != 0) {
+    return 1;
+  }
+  int result = partition_graph(&graph, prefix, shard_count, kind);
+  graph_close(&graph);
+  return result;
+}
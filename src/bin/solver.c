@@ -1,5 +1,495 @@
-#include <stdio.h>
+#include "header.h"
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
 
-int main() {
-  puts("testing");
+static uint64_t now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint32_t find_title(const struct Graph* graph, const char* title) {
+  uint32_t id = interner_view_find(&graph->titles, title, strlen(title));
+  if (id == UINT32_MAX) {
+    printf("Unknown title: %s\n", title);
+  }
+  return id;
+}
+
+// Long enough for a query with a few banned titles after it
+#define QUERY_LINE_MAX (16 * TITLE_MAX_LENGTH)
+#define SOLVER_MAX_VARIANTS 4
+#define VARIANT_NAME_MAX 32
+
+// A graph built with link limits, e.g. lead sections only, which queries pick
+// with a "graph=name" field. Variants are opened once and not reloaded.
+struct SolverVariant {
+  char name[VARIANT_NAME_MAX];
+  const char* path;
+  struct Graph graph;
+  struct SearchState state;
+};
+
+struct Solver {
+  // Either owned_graph or the generation of the reloader the solver is in
+  const struct Graph* graph;
+  struct Graph owned_graph;
+  struct GraphReloader* reloader; // NULL unless watching the graph file
+  uint32_t reader;
+  uint64_t generation;
+  struct SearchState state;
+  uint32_t prefetch_distance; // for every search state, 0 when off
+  const char* mask_path;
+  struct NodeMasks masks;
+  int has_masks;
+  uint64_t* banned;
+  char constraint_fields[QUERY_LINE_MAX]; // of the constraints in the state
+  struct LabelIndex labels;
+  int has_labels;
+  struct DistributedSearch distributed;
+  int is_distributed;
+  struct QueryCache* cache; // NULL when caching is off
+  struct QueryCacheOptions cache_options;
+  struct SolverVariant variants[SOLVER_MAX_VARIANTS];
+  uint32_t variant_count;
+  uint32_t variants_open;
+};
+
+// Runs the search the solver was started with
+static uint32_t solve(struct Solver* solver, uint32_t source, uint32_t target,
+                      uint32_t* path) {
+  if (solver->is_distributed) {
+    uint32_t length = distributed_shortest_path(&solver->distributed, source,
+                                                target, path);
+    solver->state.nodes_visited = solver->distributed.nodes_visited;
+    return length;
+  }
+  if (solver->has_labels) {
+    return label_shortest_path(solver->graph, &solver->labels, source, target,
+                               path);
+  }
+  return search_shortest_path(solver->graph, &solver->state, source, target,
+                              path);
+}
+
+// Compiles the tab separated constraint fields of a query into the search
+// state: "hops=N", "ban=Title" and "exclude=mask expression", see
+// node_masks_compile. A query with the same fields as the last one reuses
+// them as they are. Returns 0 on success, otherwise the search is left
+// unconstrained.
+static int apply_constraints(struct Solver* solver, const char* fields) {
+  if (strcmp(fields, solver->constraint_fields) == 0) {
+    return 0;
+  }
+  const struct Graph* graph = solver->graph;
+  struct SearchConstraints constraints = search_constraints_none();
+  char copy[QUERY_LINE_MAX];
+  snprintf(copy, sizeof(copy), "%s", fields);
+  int result = 0;
+  for (char* field = strtok(copy, "\t"); field != NULL && result == 0;
+       field = strtok(NULL, "\t")) {
+    // Only queries that ban something pay for clearing the bitmap
+    int bans = strncmp(field, "ban=", 4) == 0 ||
+               strncmp(field, "exclude=", 8) == 0;
+    if (bans && constraints.banned == NULL) {
+      memset(solver->banned, 0,
+             (graph->node_count / 64 + 1) * sizeof(uint64_t));
+      constraints.banned = solver->banned;
+    }
+    if (strncmp(field, "hops=", 5) == 0) {
+      constraints.max_hops = strtoul(field + 5, NULL, 10);
+    } else if (strncmp(field, "ban=", 4) == 0) {
+      uint32_t id = find_title(graph, field + 4);
+      if (id == UINT32_MAX) {
+        result = 1;
+        break;
+      }
+      solver->banned[id >> 6] |= 1ULL << (id & 63);
+    } else if (strncmp(field, "exclude=", 8) == 0) {
+      if (!solver->has_masks) {
+        printf("No masks loaded, start the solver with -M masks\n");
+        result = 1;
+        break;
+      }
+      uint32_t words = solver->masks.words;
+      uint64_t* excluded = malloc(words * sizeof(uint64_t));
+      result = node_masks_compile(&solver->masks, field + 8, excluded);
+      for (uint32_t w = 0; result == 0 && w < words; w++) {
+        solver->banned[w] |= excluded[w];
+      }
+      free(excluded);
+    } else {
+      printf("Unknown constraint %s, expected hops=, ban= or exclude=\n",
+             field);
+      result = 1;
+    }
+  }
+  if (result != 0) {
+    constraints = search_constraints_none();
+  }
+  // One call per switch, so going from one banned set to another is a single
+  // copy of the bitmap
+  search_state_constrain(&solver->state, graph, &constraints);
+  snprintf(solver->constraint_fields, sizeof(solver->constraint_fields), "%s",
+           result == 0 ? fields : "");
+  return result;
+}
+
+// Moves everything sized for or tied to the old graph over to a new
+// generation. Runs inside the reader, so the generation stays mapped.
+static void adopt_generation(struct Solver* solver,
+                             const struct GraphGeneration* generation) {
+  const struct Graph* graph = &generation->graph;
+  solver->graph = graph;
+  search_state_destroy(&solver->state);
+  solver->state = search_state_init(graph);
+  solver->state.prefetch_distance = solver->prefetch_distance;
+  free(solver->banned);
+  solver->banned = calloc(graph->node_count / 64 + 1, sizeof(uint64_t));
+  solver->constraint_fields[0] = '\0';
+  if (solver->mask_path != NULL) {
+    // Masks are built per graph, they may not have been rebuilt yet
+    node_masks_close(&solver->masks);
+    solver->has_masks =
+        node_masks_open(&solver->masks, solver->mask_path, graph) == 0;
+  }
+  if (solver->cache != NULL) {
+    // Ids are only mapped from the generation right before
+    if (generation->previous_ids != NULL &&
+        generation->number == solver->generation + 1) {
+      solver->cache = query_cache_translate(solver->cache, graph,
+                                            generation->previous_ids);
+    } else {
+      query_cache_destroy(solver->cache);
+      solver->cache = query_cache_init(graph, &solver->cache_options);
+    }
+  }
+  solver->generation = generation->number;
+  log_info("Answering from generation %lu with %u nodes\n",
+           generation->number, graph->node_count);
+}
+
+// Takes a "graph=name" field out of the tab separated query fields and points
+// variant at the graph it names, NULL for the main graph. Returns 0 on success.
+static int take_variant(struct Solver* solver, char* fields,
+                        struct SolverVariant** variant) {
+  *variant = NULL;
+  for (char* field = fields; *field != '\0';) {
+    char* field_end = field + strcspn(field, "\t");
+    if (strncmp(field, "graph=", 6) != 0) {
+      field = *field_end == '\t' ? field_end + 1 : field_end;
+      continue;
+    }
+    const char* name = field + 6;
+    size_t length = field_end - name;
+    for (uint32_t i = 0; i < solver->variant_count; i++) {
+      if (strncmp(solver->variants[i].name, name, length) == 0 &&
+          solver->variants[i].name[length] == '\0') {
+        *variant = &solver->variants[i];
+      }
+    }
+    if (*variant == NULL) {
+      printf("Unknown graph %.*s, start the solver with -V %.*s=path\n",
+             (int) length, name, (int) length, name);
+      return 1;
+    }
+    if (*field_end == '\t') {
+      memmove(field, field_end + 1, strlen(field_end + 1) + 1);
+    } else {
+      field[field == fields ? 0 : -1] = '\0';
+    }
+    return 0;
+  }
+  return 0;
+}
+
+// Answers one "Source\tTarget[\tConstraint]..." query line
+static void run_query(struct Solver* solver, char* line) {
+  line[strcspn(line, "\r\n")] = '\0';
+  char* separator = strchr(line, '\t');
+  if (separator == NULL) {
+    printf("Expected a query of the form: Source<TAB>Target\n");
+    return;
+  }
+  *separator = '\0';
+  char* target_title = separator + 1;
+  char* fields = target_title + strcspn(target_title, "\t");
+  if (*fields == '\t') {
+    *fields++ = '\0';
+  }
+  struct SolverVariant* variant;
+  if (take_variant(solver, fields, &variant) != 0) {
+    return;
+  }
+  if (variant != NULL && fields[0] != '\0') {
+    printf("Constraints only apply to the main graph\n");
+    return;
+  }
+  const struct Graph* graph = variant != NULL ? &variant->graph : solver->graph;
+  struct SearchState* state =
+      variant != NULL ? &variant->state : &solver->state;
+  uint32_t source = find_title(graph, line);
+  uint32_t target = find_title(graph, target_title);
+  if (source == UINT32_MAX || target == UINT32_MAX ||
+      (variant == NULL && apply_constraints(solver, fields) != 0)) {
+    return;
+  }
+
+  uint32_t path[SEARCH_MAX_PATH];
+  uint64_t start = now_ns();
+  state->nodes_visited = 0;
+  uint32_t length = QUERY_CACHE_MISS;
+  // Cached paths, labels and shards don't know about constraints or variants,
+  // so those queries always run the BFS
+  int constrained = variant == NULL && solver->constraint_fields[0] != '\0';
+  if (solver->cache != NULL && !constrained && variant == NULL) {
+    length = query_cache_lookup(solver->cache, source, target, path);
+  }
+  int cached = length != QUERY_CACHE_MISS;
+  if (constrained || variant != NULL) {
+    length = search_shortest_path(graph, state, source, target, path);
+  } else if (!cached) {
+    length = solve(solver, source, target, path);
+    if (solver->cache != NULL) {
+      query_cache_insert(solver->cache, source, target, path, length);
+    }
+  }
+  uint64_t elapsed = now_ns() - start;
+  if (length == 0) {
+    printf("No path\n");
+  } else {
+    char scratch[TITLE_MAX_LENGTH];
+    for (uint32_t i = 0; i < length; i++) {
+      struct Str title = interner_view_get(&graph->titles, path[i], scratch);
+      printf("%s%.*s", i == 0 ? "" : " -> ", (int) title.length, title.data);
+    }
+    printf("\n");
+  }
+  log_info("%u clicks, %u nodes visited in %.1f us%s%s%s\n",
+           length == 0 ? 0 : length - 1, state->nodes_visited, elapsed / 1e3,
+           cached ? " (cached)" : constrained ? " (constrained)" : "",
+           variant != NULL ? " on " : "", variant != NULL ? variant->name : "");
+  fflush(stdout);
+  // The answer is out, so a target that turned hot gets its tree before the
+  // next query instead of inside this one
+  if (solver->cache != NULL) {
+    query_cache_build_trees(solver->cache);
+  }
+}
+
+int main(int argc, char* argv[]) {
+  uint64_t start = now_ns();
+  set_log_level(LOG_LEVEL_INFO);
+  struct GraphLoadOptions load_options = graph_load_default_options();
+  struct QueryCacheOptions cache_options = query_cache_default_options();
+  int use_cache = 0;
+  uint32_t shard_count = 0;
+  const char* shard_prefix = "inputs/graph.shard";
+  enum TransportKind transport = TRANSPORT_UNIX_SOCKET;
+  const char* mask_path = NULL;
+  uint32_t watch_ms = 0;
+  struct Solver solver = {0};
+  int opt;
+  while ((opt = getopt(argc, argv, "f:lH:s:p:mt:q:M:w:P:V:h")) != -1) {
+    switch (opt) {
+    case 'f':
+      load_options.prefault_threads = strtoul(optarg, NULL, 10);
+      break;
+    case 'l':
+      load_options.lock = 1;
+      break;
+    case 'H':
+      load_options.huge_pages = strcmp(optarg, "explicit") == 0
+                                    ? GRAPH_HUGE_PAGES_EXPLICIT
+                                    : GRAPH_HUGE_PAGES_TRANSPARENT;
+      break;
+    case 's':
+      shard_count = strtoul(optarg, NULL, 10);
+      break;
+    case 'p':
+      shard_prefix = optarg;
+      break;
+    case 'm':
+      transport = TRANSPORT_SHARED_MEMORY;
+      break;
+    case 't':
+      cache_options.tree_budget_bytes = strtoull(optarg, NULL, 10) << 20;
+      use_cache = 1;
+      break;
+    case 'q':
+      cache_options.pair_budget_bytes = strtoull(optarg, NULL, 10) << 20;
+      use_cache = 1;
+      break;
+    case 'M':
+      mask_path = optarg;
+      break;
+    case 'w':
+      watch_ms = strtoul(optarg, NULL, 10);
+      break;
+    case 'P':
+      solver.prefetch_distance = strtoul(optarg, NULL, 10);
+      break;
+    case 'V': {
+      char* equals = strchr(optarg, '=');
+      if (equals == NULL || equals == optarg ||
+          equals - optarg >= VARIANT_NAME_MAX ||
+          solver.variant_count == SOLVER_MAX_VARIANTS) {
+        log_error("Expected at most %u -V name=path, got %s\n",
+                  SOLVER_MAX_VARIANTS, optarg);
+        return 1;
+      }
+      struct SolverVariant* variant = &solver.variants[solver.variant_count++];
+      memcpy(variant->name, optarg, equals - optarg);
+      variant->path = equals + 1;
+      break;
+    }
+    default:
+      fprintf(stderr,
+              "usage: %s [-f prefault threads] [-l] [-H transparent|explicit] "
+              "[-s shards] [-p shard prefix] [-m] [-t tree cache MB] "
+              "[-q pair cache MB] [-M masks] [-w watch interval ms] "
+              "[-P prefetch distance] [-V name=graph]... [graph] [labels]\n",
+              argv[0]);
+      return 1;
+    }
+  }
+  const char* graph_path = optind < argc ? argv[optind] : "inputs/graph.bin";
+  const char* label_path = optind + 1 < argc ? argv[optind + 1] : NULL;
+
+  if (watch_ms > 0 && (label_path != NULL || shard_count > 0)) {
+    log_error("Labels and shards are built for one graph, they can't be "
+              "used with -w\n");
+    return 1;
+  }
+
+  solver.mask_path = mask_path;
+  solver.cache_options = cache_options;
+  if (watch_ms > 0) {
+    solver.reloader = graph_reloader_init(graph_path, &load_options);
+    if (solver.reloader == NULL) {
+      return 1;
+    }
+    solver.reader = graph_reloader_register(solver.reloader);
+    const struct GraphGeneration* generation =
+        graph_reloader_enter(solver.reloader, solver.reader);
+    solver.graph = &generation->graph;
+    solver.generation = generation->number;
+    graph_reloader_exit(solver.reloader, solver.reader);
+  } else {
+    if (graph_open_with(&solver.owned_graph, graph_path, &load_options) != 0) {
+      return 1;
+    }
+    solver.graph = &solver.owned_graph;
+  }
+  const struct Graph* graph = solver.graph;
+  log_info("Loaded %u nodes, %u edges and %u components from %s\n",
+           graph->node_count, graph->edge_count, graph->component_count,
+           graph_path);
+  if (label_path != NULL) {
+    if (label_index_open(&solver.labels, label_path, graph) != 0) {
+      graph_close(&solver.owned_graph);
+      return 1;
+    }
+    solver.has_labels = 1;
+    log_info("Answering distances from the labels in %s\n", label_path);
+  }
+  if (shard_count > 0) {
+    // Only the titles of the graph file are read from here on
+    if (distributed_search_init(&solver.distributed, shard_prefix, shard_count,
+                                transport) != 0) {
+      label_index_close(&solver.labels);
+      graph_close(&solver.owned_graph);
+      return 1;
+    }
+    solver.is_distributed = 1;
+    log_info("Searching across %u shard processes at %s\n", shard_count,
+             shard_prefix);
+  }
+
+  if (mask_path != NULL) {
+    if (node_masks_open(&solver.masks, mask_path, graph) != 0) {
+      if (solver.is_distributed) {
+        distributed_search_destroy(&solver.distributed);
+      }
+      label_index_close(&solver.labels);
+      if (solver.reloader != NULL) {
+        graph_reloader_destroy(solver.reloader);
+      }
+      graph_close(&solver.owned_graph);
+      return 1;
+    }
+    solver.has_masks = 1;
+    log_info("Loaded %u masks from %s\n", solver.masks.count, mask_path);
+  }
+
+  solver.state = search_state_init(graph);
+  solver.state.prefetch_distance = solver.prefetch_distance;
+  solver.banned = calloc(graph->node_count / 64 + 1, sizeof(uint64_t));
+  if (use_cache) {
+    solver.cache = query_cache_init(graph, &cache_options);
+  }
+  if (solver.reloader != NULL &&
+      graph_reloader_watch(solver.reloader, watch_ms) == 0) {
+    log_info("Watching %s for a new graph every %u ms\n", graph_path,
+             watch_ms);
+  }
+  int status = 0;
+  for (uint32_t i = 0; i < solver.variant_count && status == 0; i++) {
+    struct SolverVariant* variant = &solver.variants[i];
+    status = graph_open_with(&variant->graph, variant->path, &load_options);
+    if (status == 0) {
+      variant->state = search_state_init(&variant->graph);
+      variant->state.prefetch_distance = solver.prefetch_distance;
+      solver.variants_open++;
+      log_info("Loaded graph=%s with %u nodes and %u edges from %s\n",
+               variant->name, variant->graph.node_count,
+               variant->graph.edge_count, variant->path);
+    }
+  }
+  if (status == 0) {
+    log_info("Ready in %.1f ms\n", (now_ns() - start) / 1e6);
+  }
+  char line[QUERY_LINE_MAX];
+  while (status == 0 && fgets(line, sizeof(line), stdin) != NULL) {
+    if (solver.reloader == NULL) {
+      run_query(&solver, line);
+      continue;
+    }
+    // The generation can only be unmapped between queries
+    const struct GraphGeneration* generation =
+        graph_reloader_enter(solver.reloader, solver.reader);
+    if (generation->number != solver.generation) {
+      adopt_generation(&solver, generation);
+    }
+    run_query(&solver, line);
+    graph_reloader_exit(solver.reloader, solver.reader);
+  }
+
+  if (solver.cache != NULL) {
+    struct QueryCacheStats stats = query_cache_stats(solver.cache);
+    double lookups = stats.lookups > 0 ? stats.lookups : 1;
+    log_info("Cache: %lu lookups, %.1f%% tree hits, %.1f%% pair hits, "
+             "%lu trees built, %lu evicted, %lu pairs evicted\n",
+             stats.lookups, 100 * stats.tree_hits / lookups,
+             100 * stats.pair_hits / lookups, stats.trees_built,
+             stats.tree_evictions, stats.pair_evictions);
+    query_cache_destroy(solver.cache);
+  }
+  for (uint32_t i = 0; i < solver.variants_open; i++) {
+    search_state_destroy(&solver.variants[i].state);
+    graph_close(&solver.variants[i].graph);
+  }
+  search_state_destroy(&solver.state);
+  free(solver.banned);
+  node_masks_close(&solver.masks);
+  if (solver.is_distributed) {
+    distributed_search_destroy(&solver.distributed);
+  }
+  label_index_close(&solver.labels);
+  if (solver.reloader != NULL) {
+    graph_reloader_destroy(solver.reloader);
+  }
+  graph_close(&solver.owned_graph);
+  return status;
 }
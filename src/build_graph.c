@@ -4,27 +4,120 @@
 #include <stdlib.h>
 #include <string.h>
 
+// 16 bytes as a GCC vector type, compared with SSE2 without a -march flag
+typedef signed char Bytes16 __attribute__((vector_size(16)));
+
+// Returns the first position in [data, end) where byte a is followed by b, or
+// NULL. Used for the "\n==" of headings: matching two bytes at once is about
+// twice as fast as memmem and doesn't stop at every newline like memchr.
+static char* find_pair(char* data, char* end, char a, char b) {
+  char* cursor = data;
+  while (end - cursor > 16) {
+    Bytes16 first;
+    Bytes16 second;
+    memcpy(&first, cursor, sizeof(first));
+    memcpy(&second, cursor + 1, sizeof(second));
+    Bytes16 hits = (first == a) & (second == b);
+    uint64_t halves[2];
+    memcpy(halves, &hits, sizeof(halves));
+    if ((halves[0] | halves[1]) != 0) {
+      return cursor + (halves[0] != 0 ? __builtin_ctzll(halves[0]) / 8
+                                      : 8 + __builtin_ctzll(halves[1]) / 8);
+    }
+    cursor += 16;
+  }
+  for (; end - cursor > 1; cursor++) {
+    if (cursor[0] == a && cursor[1] == b) {
+      return cursor;
+    }
+  }
+  return NULL;
+}
+
+// Returns a pointer to the closing </text> tag of the current page, or NULL
+// when the text runs past the end of the buffer. Text bodies are XML escaped,
+// so the first '<' is almost always the closing tag. glibc's memchr is
+// vectorised already, and faster here than find_pair.
+static char* find_text_close(struct Str* buf) {
+  char* end = buf->data + buf->length;
+  char* found = buf->data;
+  while ((found = memchr(found, '<', end - found)) != NULL) {
+    if (end - found >= 7 && memcmp(found, "</text>", 7) == 0) {
+      return found;
+    }
+    found += 1;
+  }
+  return NULL;
+}
+
+// Returns the start of the first section heading in [data, end), a line
+// starting with "==", or end when the text has none
+static char* find_lead_end(char* data, char* end) {
+  char* found = data;
+  while ((found = find_pair(found, end, '\n', '=')) != NULL) {
+    if (end - found >= 3 && found[2] == '=') {
+      return found;
+    }
+    found += 1;
+  }
+  return end;
+}
+
+// Bytes kept back at the end of a read inside a text, so a "</text>" or
+// "\n==" cut in two by the read is found whole at the start of the next one
+#define TEXT_TAIL 6
+
 // Parses links within the buffer and adds them into the interner and the edges.
 // When the start of a link exists in the buffer but isn't returned, a pointer
 // to the start of the link is returned. Otherwise NULL is returned
 char* parse_links(struct Str* buf, struct Interner* interner,
                   struct VecEdge* edges, uint32_t from_id) {
+  struct ParseState state = {.from_id = from_id, .in_text = 1};
+  return parse_links_with(buf, interner, edges, &state,
+                          &(struct LinkLimits) {0});
+}
+
+char* parse_links_with(struct Str* buf, struct Interner* interner,
+                       struct VecEdge* edges, struct ParseState* state,
+                       const struct LinkLimits* limits) {
   log_trace("called parse_links: %u\n", buf->length);
+  // Only look for links up to the end of this page's text, otherwise the links
+  // of every following page in the buffer are attributed to this one
+  char* text_close = find_text_close(buf);
+  char* buffer_end = buf->data + buf->length;
+  char* end = text_close != NULL ? text_close : buffer_end;
+  state->in_text = text_close == NULL;
+  if (state->skipping) {
+    end = buf->data;
+  } else if (limits->lead_only) {
+    char* lead_end = find_lead_end(buf->data, end);
+    state->skipping = lead_end != end;
+    end = lead_end;
+  }
+  // Links are only cut off by the buffer when the scan runs into its end
+  int cut_by_buffer = end == buffer_end;
   char* found = buf->data;
-  while ((found = memchr(found, '[', buf->length)) != NULL) {
+  while ((found = memchr(found, '[', end - found)) != NULL) {
     str_advance_to(buf, found);
-    log_trace("called parse_links inner: %u. %s\n", buf->length, found);
+    log_trace("called parse_links inner: %u\n", buf->length);
+    if (found + 1 == end) {
+      log_trace("parse_links: found returned");
+      return cut_by_buffer ? found : NULL;
+    }
     if (found[1] != '[') {
       found += 1;
       log_trace("parse_links: continued");
       continue;
     }
     found += 2;
-    str_advance_to(buf, found);
 
     // we assume that no links have a ] in them
-    char* link_close = memchr(found, ']', buf->length);
+    char* link_close = memchr(found, ']', end - found);
     if (link_close == NULL) {
+      if (!cut_by_buffer) {
+        // Unterminated link inside a complete text, nothing left to parse
+        break;
+      }
       log_trace("parse_links: found returned");
       return found - 2;
     }
@@ -34,23 +127,74 @@ char* parse_links(struct Str* buf, struct Interner* interner,
     char* link_title = found;
     uint32_t link_len =
         label_start == NULL ? link_close - found : label_start - found;
+    found = link_close + 1;
+    if (link_len >= TITLE_MAX_LENGTH) {
+      // Not a title, most likely a stray [[ in the text
+      str_advance_to(buf, found);
+      continue;
+    }
 
     uint32_t to_id = intern_from_cstr(interner, link_title, link_len);
 
-    struct Edge edge = {from_id, to_id};
+    struct Edge edge = {state->from_id, to_id};
     vec_edge_push(edges, edge);
+    // Past the link, so a text carried over to the next read doesn't repeat it
+    str_advance_to(buf, found);
+    if (++state->link_count == limits->max_links) {
+      state->skipping = 1;
+      break;
+    }
+  }
+  // Fast-forwards over whatever the limits left unread
+  if (text_close != NULL) {
+    str_advance_to(buf, text_close);
   }
   return NULL;
 }
 
+// Parses the rest of the text the buffer is in. Returns where the next read
+// has to start from when the text runs past the end of the buffer, otherwise
+// NULL.
+static char* continue_text(struct Str* buf, struct Interner* interner,
+                           struct VecEdge* edges, struct ParseState* state,
+                           const struct LinkLimits* limits) {
+  char* extra_links = parse_links_with(buf, interner, edges, state, limits);
+  if (extra_links != NULL || !state->in_text) {
+    return extra_links;
+  }
+  char* end = buf->data + buf->length;
+  return buf->length > TEXT_TAIL ? end - TEXT_TAIL : buf->data;
+}
+
 char* parse_buffer(struct Str* buf, struct Interner* interner,
                    struct VecEdge* edges, uint32_t* from_id) {
+  struct ParseState state = {.from_id = *from_id};
+  char* result = parse_buffer_with(buf, interner, edges, &state,
+                                   &(struct LinkLimits) {0});
+  *from_id = state.from_id;
+  return result;
+}
+
+char* parse_buffer_with(struct Str* buf, struct Interner* interner,
+                        struct VecEdge* edges, struct ParseState* state,
+                        const struct LinkLimits* limits) {
   log_trace("called parse_buffer: %u\n", buf->length);
+  // The text the last read ended in carries on from the start of this one
+  if (state->in_text) {
+    char* carry = continue_text(buf, interner, edges, state, limits);
+    if (carry != NULL) {
+      return carry;
+    }
+  }
   // TODO: do math to reduce the len when we move the buffer pointer
   char* open_tag = NULL;
   // TODO: could replace this with a simd check instead, maybe this would be
   // move overhead
   while ((open_tag = memchr(buf->data, '<', buf->length))) {
+    if (open_tag + 6 > buf->data + buf->length) {
+      // Tag name is split across buffers
+      return open_tag;
+    }
     if (open_tag[1] == 't' && open_tag[2] == 'i' && open_tag[3] == 't' &&
         open_tag[4] == 'l' && open_tag[5] == 'e') {
       // Is title tag
@@ -68,8 +212,8 @@ char* parse_buffer(struct Str* buf, struct Interner* interner,
         return open_tag;
       }
       log_trace("tag_close_start");
-      *from_id = intern_from_cstr(interner, tag_end + 1,
-                                  tag_close_start - tag_end - 1);
+      state->from_id = intern_from_cstr(interner, tag_end + 1,
+                                        tag_close_start - tag_end - 1);
       // TODO: add test showing that this should be returned, it currenty isn't
       log_trace("from_id");
 
@@ -77,14 +221,23 @@ char* parse_buffer(struct Str* buf, struct Interner* interner,
                open_tag[4] == 't') {
       log_trace("is text");
       // Is text tag
-      char* extra_links = parse_links(buf, interner, edges, *from_id);
-      if (extra_links != NULL) {
+      char* tag_end =
+          memchr(open_tag, '>', buf->data + buf->length - open_tag);
+      if (tag_end == NULL) {
+        return open_tag;
+      }
+      str_advance_to(buf, tag_end + 1);
+      // Empty pages have a self closing <text ... />
+      if (tag_end[-1] == '/') {
+        continue;
+      }
+      state->skipping = 0;
+      state->link_count = 0;
+      char* carry = continue_text(buf, interner, edges, state, limits);
+      if (carry != NULL) {
         log_trace("Returning");
-        return extra_links;
+        return carry;
       }
-      // Not sure about this, we need the opening < so that it can recall this
-      // function but it seems inefficent, maybe a buffer overhang might be more
-      // efficent
     } else {
       str_advance_to(buf, open_tag + 1);
     }
@@ -114,7 +267,7 @@ void print_progress(size_t count, size_t max) {
 
 int build_graph_inner(FILE* xml_file, uint64_t buff_size,
                       struct Interner* interner, struct VecEdge* edges,
-                      char* output_path) {
+                      char* output_path, const struct BuildOptions* options) {
   fseek(xml_file, 0, SEEK_END);
   uint64_t file_size = ftell(xml_file);
   fseek(xml_file, 0, SEEK_SET);
@@ -123,35 +276,46 @@ int build_graph_inner(FILE* xml_file, uint64_t buff_size,
   uint64_t buf_offset = 0;
   uint64_t amount_read = 0;
   uint64_t amount_read_total = 0;
-  uint32_t from_id = UINT32_MAX;
+  struct ParseState state = {.from_id = UINT32_MAX};
 
-  while ((amount_read = fread(buf + buf_offset, 1, buff_size, xml_file)) > 0) {
+  while ((amount_read = fread(buf + buf_offset, 1, buff_size - buf_offset,
+                              xml_file)) > 0) {
     amount_read_total += amount_read;
-    // printf("\nbuf_offset: %lu\n", buf_offset);
 
-    struct Str str = {.data = buf, .length = buff_size};
-    char* buffer_end = parse_buffer(&str, interner, edges, &from_id);
-    if (buffer_end) {
-      log_trace("Returning pointer offset %ld\n", buffer_end - buf);
-    }
+    uint64_t buf_length = buf_offset + amount_read;
+    struct Str str = {.data = buf, .length = buf_length};
+    char* buffer_end = parse_buffer_with(&str, interner, edges, &state,
+                                         &options->link_limits);
 
     if (buffer_end != NULL) {
-      log_trace("is null");
-      buf_offset = buffer_end - buf;
+      // Carry the incomplete tail over to the start of the next read
+      log_trace("Returning pointer offset %ld\n", buffer_end - buf);
+      buf_offset = buf + buf_length - buffer_end;
       memmove(buf, buffer_end, buf_offset);
     } else {
       buf_offset = 0;
     }
+    if (buf_offset == buff_size) {
+      log_error("\nA tag or link doesn't fit in a %lu byte buffer\n",
+                buff_size);
+      free(buf);
+      return 1;
+    }
     print_progress(amount_read_total, file_size);
   }
-  // TODO: sort the edges by from
-  // TODO: write the edges
-  // TODO: write the interner
-  return 0;
+  free(buf);
+  return graph_write(output_path, interner, edges, options);
+}
+
+struct BuildOptions build_options_default() {
+  return (struct BuildOptions) {
+      .title_encoding = TITLE_ENCODING_PLAIN,
+      .output_path = "inputs/graph.bin",
+  };
 }
 
 // builds the graph and writes it to the output graph file
-int build_graph() {
+int build_graph(const struct BuildOptions* options) {
   FILE* xml_file = fopen(XML_FILE_PATH, "r");
   if (xml_file == NULL) {
     perror("Failed to open xml file");
@@ -161,7 +325,6 @@ int build_graph() {
   struct Interner interner = interner_init(1 << 20);
   struct VecEdge edges = vec_edge_init(1 << 20);
 
-  char* output_path = "inputs/graph.bin";
-
-  return build_graph_inner(xml_file, BUFF_SIZE, &interner, &edges, output_path);
+  return build_graph_inner(xml_file, BUFF_SIZE, &interner, &edges,
+                           (char*) options->output_path, options);
 }
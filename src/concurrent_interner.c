@@ -0,0 +1,204 @@
+#include "header.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Interner that many threads can call at once. Titles are hashed to one of
+// CONCURRENT_INTERNER_SHARDS open addressing tables, each behind its own
+// mutex, so threads only contend when they hit the same shard. Ids come from
+// one atomic counter and index a chunked table of Str that never moves, so
+// lookups by id need no lock. String bytes go into per thread arena blocks.
+
+#define SLOT_EMPTY UINT32_MAX
+#define LOCAL_BLOCK_SIZE (1 << 20)
+
+struct InternerSlot {
+  uint32_t hash;
+  uint32_t id;
+};
+
+struct InternerShard {
+  pthread_mutex_t lock;
+  struct InternerSlot* slots;
+  uint32_t capacity; // power of two
+  uint32_t length;
+} __attribute__((aligned(64)));
+
+struct InternerBlock {
+  struct InternerBlock* next;
+  char data[];
+};
+
+struct ConcurrentInterner {
+  struct InternerShard shards[CONCURRENT_INTERNER_SHARDS];
+  atomic_uint next_id;
+  pthread_mutex_t chunk_lock;
+  _Atomic(struct Str*) chunks[CONCURRENT_INTERNER_MAX_CHUNKS];
+  pthread_mutex_t block_lock;
+  struct InternerBlock* blocks;
+};
+
+// FNV-1a, titles are short so this is hard to beat without SIMD
+static uint64_t hash_bytes(const char* s, size_t len) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (size_t i = 0; i < len; i++) {
+    hash ^= (uint8_t) s[i];
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+struct ConcurrentInterner* concurrent_interner_init(uint32_t capacity) {
+  struct ConcurrentInterner* interner =
+      calloc(1, sizeof(struct ConcurrentInterner));
+  uint32_t shard_capacity = 16;
+  while (shard_capacity * CONCURRENT_INTERNER_SHARDS < capacity * 2) {
+    shard_capacity *= 2;
+  }
+  for (int i = 0; i < CONCURRENT_INTERNER_SHARDS; i++) {
+    struct InternerShard* shard = &interner->shards[i];
+    pthread_mutex_init(&shard->lock, NULL);
+    shard->capacity = shard_capacity;
+    shard->slots = malloc(shard_capacity * sizeof(struct InternerSlot));
+    for (uint32_t j = 0; j < shard_capacity; j++) {
+      shard->slots[j].id = SLOT_EMPTY;
+    }
+  }
+  pthread_mutex_init(&interner->chunk_lock, NULL);
+  pthread_mutex_init(&interner->block_lock, NULL);
+  return interner;
+}
+
+void concurrent_interner_destroy(struct ConcurrentInterner* interner) {
+  for (int i = 0; i < CONCURRENT_INTERNER_SHARDS; i++) {
+    pthread_mutex_destroy(&interner->shards[i].lock);
+    free(interner->shards[i].slots);
+  }
+  for (uint32_t i = 0; i < CONCURRENT_INTERNER_MAX_CHUNKS; i++) {
+    free(atomic_load(&interner->chunks[i]));
+  }
+  struct InternerBlock* block = interner->blocks;
+  while (block != NULL) {
+    struct InternerBlock* next = block->next;
+    free(block);
+    block = next;
+  }
+  pthread_mutex_destroy(&interner->chunk_lock);
+  pthread_mutex_destroy(&interner->block_lock);
+  free(interner);
+}
+
+struct InternerLocal interner_local_init(struct ConcurrentInterner* interner) {
+  return (struct InternerLocal) {.interner = interner};
+}
+
+// Copies s NUL terminated into the thread's current block. Blocks are owned by
+// the interner so strings outlive the thread that added them.
+static char* local_copy(struct InternerLocal* local, const char* s,
+                        size_t len) {
+  if (local->block == NULL || local->used + len + 1 > local->capacity) {
+    size_t capacity = len + 1 > LOCAL_BLOCK_SIZE ? len + 1 : LOCAL_BLOCK_SIZE;
+    struct InternerBlock* block =
+        malloc(sizeof(struct InternerBlock) + capacity);
+    pthread_mutex_lock(&local->interner->block_lock);
+    block->next = local->interner->blocks;
+    local->interner->blocks = block;
+    pthread_mutex_unlock(&local->interner->block_lock);
+    local->block = block->data;
+    local->used = 0;
+    local->capacity = capacity;
+  }
+  char* copy = local->block + local->used;
+  memcpy(copy, s, len);
+  copy[len] = '\0';
+  local->used += len + 1;
+  return copy;
+}
+
+static struct Str* id_entry(struct ConcurrentInterner* interner, uint32_t id) {
+  uint32_t chunk = id >> CONCURRENT_INTERNER_CHUNK_BITS;
+  struct Str* entries =
+      atomic_load_explicit(&interner->chunks[chunk], memory_order_acquire);
+  if (entries == NULL) {
+    pthread_mutex_lock(&interner->chunk_lock);
+    entries = atomic_load_explicit(&interner->chunks[chunk],
+                                   memory_order_relaxed);
+    if (entries == NULL) {
+      entries =
+          calloc(1 << CONCURRENT_INTERNER_CHUNK_BITS, sizeof(struct Str));
+      atomic_store_explicit(&interner->chunks[chunk], entries,
+                            memory_order_release);
+    }
+    pthread_mutex_unlock(&interner->chunk_lock);
+  }
+  return &entries[id & ((1 << CONCURRENT_INTERNER_CHUNK_BITS) - 1)];
+}
+
+static void shard_grow(struct InternerShard* shard) {
+  uint32_t capacity = shard->capacity * 2;
+  struct InternerSlot* slots = malloc(capacity * sizeof(struct InternerSlot));
+  for (uint32_t i = 0; i < capacity; i++) {
+    slots[i].id = SLOT_EMPTY;
+  }
+  for (uint32_t i = 0; i < shard->capacity; i++) {
+    struct InternerSlot slot = shard->slots[i];
+    if (slot.id == SLOT_EMPTY) {
+      continue;
+    }
+    uint32_t index = slot.hash & (capacity - 1);
+    while (slots[index].id != SLOT_EMPTY) {
+      index = (index + 1) & (capacity - 1);
+    }
+    slots[index] = slot;
+  }
+  free(shard->slots);
+  shard->slots = slots;
+  shard->capacity = capacity;
+}
+
+uint32_t concurrent_intern(struct InternerLocal* local, const char* s,
+                           size_t len) {
+  struct ConcurrentInterner* interner = local->interner;
+  uint64_t hash = hash_bytes(s, len);
+  // Low bits pick the shard, the high half probes inside it
+  struct InternerShard* shard =
+      &interner->shards[hash & (CONCURRENT_INTERNER_SHARDS - 1)];
+  uint32_t slot_hash = (uint32_t) (hash >> 32);
+
+  pthread_mutex_lock(&shard->lock);
+  uint32_t index = slot_hash & (shard->capacity - 1);
+  while (shard->slots[index].id != SLOT_EMPTY) {
+    struct InternerSlot slot = shard->slots[index];
+    if (slot.hash == slot_hash) {
+      struct Str* entry = id_entry(interner, slot.id);
+      if (entry->length == len && memcmp(entry->data, s, len) == 0) {
+        pthread_mutex_unlock(&shard->lock);
+        return slot.id;
+      }
+    }
+    index = (index + 1) & (shard->capacity - 1);
+  }
+
+  uint32_t id = atomic_fetch_add(&interner->next_id, 1);
+  struct Str* entry = id_entry(interner, id);
+  entry->data = local_copy(local, s, len);
+  entry->length = len;
+  shard->slots[index] = (struct InternerSlot) {.hash = slot_hash, .id = id};
+  shard->length++;
+  if (shard->length * 10 > shard->capacity * 7) {
+    shard_grow(shard);
+  }
+  pthread_mutex_unlock(&shard->lock);
+  return id;
+}
+
+struct Str concurrent_interner_get(struct ConcurrentInterner* interner,
+                                   uint32_t id) {
+  return *id_entry(interner, id);
+}
+
+uint32_t concurrent_interner_length(struct ConcurrentInterner* interner) {
+  return atomic_load(&interner->next_id);
+}
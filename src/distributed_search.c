@@ -0,0 +1,375 @@
+#include "header.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Level synchronous BFS over a partitioned graph. The coordinator owns no
+// edges, each step it hands every shard the candidates other shards found for
+// it. A shard keeps the candidates it accepts as its frontier, expands it,
+// keeps the neighbours it owns for its next frontier and returns the rest
+// grouped by owner. Edges in messages are (parent, node).
+
+static inline int bit_test(const uint64_t* bits, uint32_t i) {
+  return (bits[i >> 6] >> (i & 63)) & 1;
+}
+
+static inline void bit_set(uint64_t* bits, uint32_t i) {
+  bits[i >> 6] |= 1ULL << (i & 63);
+}
+
+// ====== Shard server ===== //
+
+struct ShardServer {
+  struct Shard shard;
+  struct Transport* transport;
+  uint32_t target;
+  int found;
+  uint64_t* visited; // by local id
+  uint32_t* parent;  // by local id, global ids
+  uint32_t* touched; // every visited local id, for the reset
+  uint32_t touched_length;
+  uint32_t frontier_start; // touched[frontier_start..] is the next frontier
+  uint64_t* sent;          // by global id, remote candidates already sent
+  uint32_t* sent_nodes;    // the set bits of sent, for the reset
+  uint32_t sent_length;
+  uint32_t sent_capacity;
+  struct VecEdge* outgoing;
+};
+
+// Marks the local node visited, returns 0 when it already was
+static int server_visit(struct ShardServer* server, uint32_t node,
+                        uint32_t parent) {
+  uint32_t local = server->shard.local_ids[node];
+  if (bit_test(server->visited, local)) {
+    return 0;
+  }
+  bit_set(server->visited, local);
+  server->parent[local] = parent;
+  server->touched[server->touched_length++] = local;
+  if (node == server->target) {
+    server->found = 1;
+  }
+  return 1;
+}
+
+static void server_mark_sent(struct ShardServer* server, uint32_t node) {
+  bit_set(server->sent, node);
+  if (server->sent_length == server->sent_capacity) {
+    server->sent_capacity =
+        server->sent_capacity == 0 ? 1024 : server->sent_capacity * 2;
+    server->sent_nodes =
+        realloc(server->sent_nodes, server->sent_capacity * sizeof(uint32_t));
+  }
+  server->sent_nodes[server->sent_length++] = node;
+}
+
+static int server_level(struct ShardServer* server,
+                        const struct ShardMessage* request,
+                        const struct Edge* edges) {
+  struct Shard* shard = &server->shard;
+  server->target = request->node;
+  for (uint32_t i = 0; i < request->edge_count; i++) {
+    server_visit(server, edges[i].to, edges[i].from);
+  }
+  uint32_t frontier_start = server->frontier_start;
+  uint32_t frontier_end = server->touched_length;
+  server->frontier_start = frontier_end;
+
+  if (!server->found) {
+    for (uint32_t i = frontier_start; i < frontier_end; i++) {
+      uint32_t local = server->touched[i];
+      uint32_t node = shard->nodes[local];
+      for (uint32_t e = shard->out_offsets[local];
+           e < shard->out_offsets[local + 1]; e++) {
+        uint32_t next = shard->out_targets[e];
+        uint16_t owner = shard->owners[next];
+        if (owner == shard->index) {
+          server_visit(server, next, node);
+        } else if (!bit_test(server->sent, next)) {
+          server_mark_sent(server, next);
+          vec_edge_push(&server->outgoing[owner], (struct Edge) {node, next});
+        }
+      }
+      if (server->found) {
+        break;
+      }
+    }
+  }
+
+  for (uint32_t i = 0; i < shard->count; i++) {
+    struct VecEdge* batch = &server->outgoing[i];
+    if (batch->length == 0) {
+      continue;
+    }
+    struct ShardMessage reply = {.type = SHARD_MSG_CANDIDATES,
+                                 .shard = i,
+                                 .edge_count = batch->length};
+    if (transport_send(server->transport, &reply, batch->data) != 0) {
+      return 1;
+    }
+    batch->length = 0;
+  }
+  struct ShardMessage done = {
+      .type = SHARD_MSG_LEVEL_DONE,
+      .found = server->found,
+      .visited = frontier_end - frontier_start,
+      .pending = server->touched_length - frontier_end,
+  };
+  return transport_send(server->transport, &done, NULL);
+}
+
+static void server_reset(struct ShardServer* server) {
+  for (uint32_t i = 0; i < server->touched_length; i++) {
+    server->visited[server->touched[i] >> 6] = 0;
+  }
+  for (uint32_t i = 0; i < server->sent_length; i++) {
+    server->sent[server->sent_nodes[i] >> 6] = 0;
+  }
+  server->sent_length = 0;
+  server->touched_length = 0;
+  server->frontier_start = 0;
+  server->found = 0;
+}
+
+int shard_server_run(const char* prefix, uint32_t index,
+                     struct Transport* transport) {
+  struct ShardServer server = {.transport = transport};
+  if (shard_open(&server.shard, prefix, index) != 0) {
+    return 1;
+  }
+  struct Shard* shard = &server.shard;
+  server.visited = calloc(shard->local_node_count / 64 + 1, sizeof(uint64_t));
+  server.parent = malloc((shard->local_node_count + 1) * sizeof(uint32_t));
+  server.touched = malloc((shard->local_node_count + 1) * sizeof(uint32_t));
+  server.sent = calloc(shard->node_count / 64 + 1, sizeof(uint64_t));
+  server.outgoing = malloc(shard->count * sizeof(struct VecEdge));
+  for (uint32_t i = 0; i < shard->count; i++) {
+    server.outgoing[i] = vec_edge_init(1024);
+  }
+
+  int result = 0;
+  struct ShardMessage request;
+  const struct Edge* edges;
+  while (result == 0 && transport_recv(transport, &request, &edges) == 0) {
+    if (request.type == SHARD_MSG_EXIT) {
+      break;
+    }
+    switch (request.type) {
+    case SHARD_MSG_LEVEL:
+      result = server_level(&server, &request, edges);
+      break;
+    case SHARD_MSG_PARENT: {
+      uint32_t local = shard->local_ids[request.node];
+      struct ShardMessage reply = {.type = SHARD_MSG_PARENT,
+                                   .node = server.parent[local]};
+      result = transport_send(transport, &reply, NULL);
+      break;
+    }
+    case SHARD_MSG_RESET:
+      server_reset(&server);
+      break;
+    default:
+      log_error("Shard %u got unknown message %u\n", index, request.type);
+      result = 1;
+    }
+  }
+
+  for (uint32_t i = 0; i < shard->count; i++) {
+    free(server.outgoing[i].data);
+  }
+  free(server.outgoing);
+  free(server.visited);
+  free(server.parent);
+  free(server.touched);
+  free(server.sent);
+  free(server.sent_nodes);
+  shard_close(shard);
+  return result;
+}
+
+// ====== Coordinator ===== //
+
+int distributed_search_init(struct DistributedSearch* search,
+                            const char* prefix, uint32_t shard_count,
+                            enum TransportKind kind) {
+  memset(search, 0, sizeof(*search));
+  if (shard_open(&search->routing, prefix, 0) != 0) {
+    return 1;
+  }
+  if (search->routing.count != shard_count) {
+    log_error("%s has %u shards, not %u\n", prefix, search->routing.count,
+              shard_count);
+    shard_close(&search->routing);
+    return 1;
+  }
+  search->transports = calloc(shard_count, sizeof(struct Transport));
+  search->pids = calloc(shard_count, sizeof(int));
+  search->outgoing = malloc(shard_count * sizeof(struct VecEdge));
+  for (uint32_t i = 0; i < shard_count; i++) {
+    search->outgoing[i] = vec_edge_init(1024);
+  }
+
+  // Don't let the children flush what is buffered here a second time
+  fflush(NULL);
+  for (uint32_t i = 0; i < shard_count; i++) {
+    struct Transport server_end;
+    if (transport_pair(kind, &search->transports[i], &server_end) != 0) {
+      distributed_search_destroy(search);
+      return 1;
+    }
+    pid_t pid = fork();
+    if (pid == 0) {
+      for (uint32_t j = 0; j <= i; j++) {
+        transport_close(&search->transports[j]);
+      }
+      transport_watch(&server_end, getppid());
+      int result = shard_server_run(prefix, i, &server_end);
+      transport_close(&server_end);
+      _exit(result);
+    }
+    transport_close(&server_end);
+    if (pid < 0) {
+      log_error("Failed to fork the server for shard %u\n", i);
+      transport_close(&search->transports[i]);
+      distributed_search_destroy(search);
+      return 1;
+    }
+    transport_watch(&search->transports[i], pid);
+    search->pids[i] = pid;
+    search->shard_count = i + 1;
+  }
+  return 0;
+}
+
+void distributed_search_destroy(struct DistributedSearch* search) {
+  struct ShardMessage exit_message = {.type = SHARD_MSG_EXIT};
+  for (uint32_t i = 0; i < search->shard_count; i++) {
+    transport_send(&search->transports[i], &exit_message, NULL);
+    transport_close(&search->transports[i]);
+    waitpid(search->pids[i], NULL, 0);
+  }
+  for (uint32_t i = 0; search->outgoing != NULL && i < search->routing.count;
+       i++) {
+    free(search->outgoing[i].data);
+  }
+  free(search->outgoing);
+  free(search->transports);
+  free(search->pids);
+  shard_close(&search->routing);
+  memset(search, 0, sizeof(*search));
+}
+
+// Runs one level on every shard, returns 1 when the target was found, 0 when
+// the search should go on, -1 when the frontier is empty or a shard failed
+static int coordinator_level(struct DistributedSearch* search,
+                             uint32_t target, struct VecEdge* incoming) {
+  for (uint32_t i = 0; i < search->shard_count; i++) {
+    struct ShardMessage request = {.type = SHARD_MSG_LEVEL,
+                                   .node = target,
+                                   .edge_count = incoming[i].length};
+    if (transport_send(&search->transports[i], &request, incoming[i].data) !=
+        0) {
+      return -1;
+    }
+    incoming[i].length = 0;
+  }
+
+  int found = 0;
+  uint32_t remaining = 0;
+  for (uint32_t i = 0; i < search->shard_count; i++) {
+    struct ShardMessage reply;
+    const struct Edge* edges;
+    do {
+      if (transport_recv(&search->transports[i], &reply, &edges) != 0) {
+        return -1;
+      }
+      if (reply.type == SHARD_MSG_CANDIDATES) {
+        for (uint32_t e = 0; e < reply.edge_count; e++) {
+          vec_edge_push(&incoming[reply.shard], edges[e]);
+        }
+        remaining += reply.edge_count;
+      }
+    } while (reply.type == SHARD_MSG_CANDIDATES);
+    found |= reply.found;
+    remaining += reply.pending;
+    search->nodes_visited += reply.visited;
+  }
+  if (found) {
+    return 1;
+  }
+  return remaining == 0 ? -1 : 0;
+}
+
+static uint32_t coordinator_walk_parents(struct DistributedSearch* search,
+                                         uint32_t source, uint32_t target,
+                                         uint32_t* path) {
+  uint32_t length = 0;
+  uint32_t node = target;
+  while (node != source) {
+    // A level synchronous search can't find a longer path, so this is a
+    // parent chain the shards got wrong
+    if (length == SEARCH_MAX_PATH - 1) {
+      log_error("Path from %u to %u is longer than %u nodes\n", source,
+                target, SEARCH_MAX_PATH);
+      return 0;
+    }
+    path[length++] = node;
+    struct Transport* transport =
+        &search->transports[search->routing.owners[node]];
+    struct ShardMessage request = {.type = SHARD_MSG_PARENT, .node = node};
+    struct ShardMessage reply;
+    const struct Edge* edges;
+    if (transport_send(transport, &request, NULL) != 0 ||
+        transport_recv(transport, &reply, &edges) != 0) {
+      return 0;
+    }
+    node = reply.node;
+  }
+  path[length++] = source;
+  for (uint32_t i = 0; i < length / 2; i++) {
+    uint32_t tmp = path[i];
+    path[i] = path[length - 1 - i];
+    path[length - 1 - i] = tmp;
+  }
+  return length;
+}
+
+uint32_t distributed_shortest_path(struct DistributedSearch* search,
+                                   uint32_t source, uint32_t target,
+                                   uint32_t* path) {
+  search->nodes_visited = 0;
+  search->bytes_moved = 0;
+  if (source == target) {
+    path[0] = source;
+    return 1;
+  }
+  uint64_t bytes_before = 0;
+  for (uint32_t i = 0; i < search->shard_count; i++) {
+    bytes_before += search->transports[i].bytes_sent +
+                    search->transports[i].bytes_received;
+  }
+
+  // The source is its own parent, which ends the walk back
+  vec_edge_push(&search->outgoing[search->routing.owners[source]],
+                (struct Edge) {source, source});
+  int status = 0;
+  for (uint32_t depth = 0; status == 0 && depth < SEARCH_MAX_PATH - 1;
+       depth++) {
+    status = coordinator_level(search, target, search->outgoing);
+  }
+  uint32_t length =
+      status == 1 ? coordinator_walk_parents(search, source, target, path) : 0;
+
+  struct ShardMessage reset = {.type = SHARD_MSG_RESET};
+  for (uint32_t i = 0; i < search->shard_count; i++) {
+    search->outgoing[i].length = 0;
+    transport_send(&search->transports[i], &reset, NULL);
+    search->bytes_moved += search->transports[i].bytes_sent +
+                           search->transports[i].bytes_received;
+  }
+  search->bytes_moved -= bytes_before;
+  return length;
+}
@@ -0,0 +1,374 @@
+#include "header.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+// Graph file layout: a GraphHeader followed by sections, see section_file.c
+//
+//   TITLE_OFFSETS  uint32[node_count + 1], offset of each title in TITLE_BYTES
+//                  or uint32[bucket_count + 1] of each bucket when front coded
+//   TITLE_BYTES    PLAIN: every title followed by a NUL, like the arena
+//                  FRONT_CODED: buckets of varint prefix/suffix coded titles
+//   OUT_OFFSETS    uint32[node_count + 1], CSR offsets into OUT_TARGETS
+//   OUT_TARGETS    uint32[edge_count], sorted and unique per node
+//   IN_OFFSETS     uint32[node_count + 1], reverse CSR offsets into IN_TARGETS
+//   IN_TARGETS     uint32[edge_count], the pages linking to each node, sorted
+//   SCC_IDS        uint32[node_count], strongly connected component per node
+//   SCC_DAG_*      condensation DAG over components in CSR form
+//   SCC_FLAGS      uint8[component_count], SCC_FLAG_SOURCE / SCC_FLAG_SINK
+
+static int compare_u32(const void* a, const void* b) {
+  uint32_t x = *(const uint32_t*) a;
+  uint32_t y = *(const uint32_t*) b;
+  return (x > y) - (x < y);
+}
+
+// Interner used by compare_title_ids, qsort has no context argument
+static struct Interner* sort_interner;
+
+static int compare_title_ids(const void* a, const void* b) {
+  struct Slice x = sort_interner->strs.data[*(const uint32_t*) a];
+  struct Slice y = sort_interner->strs.data[*(const uint32_t*) b];
+  int result =
+      memcmp(arena_get_slice(&sort_interner->arena, x),
+             arena_get_slice(&sort_interner->arena, y),
+             x.length < y.length ? x.length : y.length);
+  if (result != 0) {
+    return result;
+  }
+  return (x.length > y.length) - (x.length < y.length);
+}
+
+// Returns the interner ids ordered by title
+static uint32_t* sort_title_ids(struct Interner* interner) {
+  uint32_t node_count = interner->strs.length;
+  uint32_t* sorted = malloc((node_count + 1) * sizeof(uint32_t));
+  for (uint32_t i = 0; i < node_count; i++) {
+    sorted[i] = i;
+  }
+  sort_interner = interner;
+  qsort(sorted, node_count, sizeof(uint32_t), compare_title_ids);
+  sort_interner = NULL;
+  return sorted;
+}
+
+static void push_varint(struct Arena* arena, uint32_t value) {
+  uint8_t bytes[5];
+  uint32_t length = 0;
+  do {
+    bytes[length] = value & 0x7f;
+    value >>= 7;
+    if (value != 0) {
+      bytes[length] |= 0x80;
+    }
+    length++;
+  } while (value != 0);
+  arena_push(arena, bytes, length);
+}
+
+// Builds the title sections in sorted order. Returns the bytes in an arena,
+// offsets has room for node_count + 1 entries.
+static struct Arena encode_titles(struct Interner* interner,
+                                  const uint32_t* sorted,
+                                  enum TitleEncoding encoding,
+                                  uint32_t* offsets) {
+  uint32_t node_count = interner->strs.length;
+  struct Arena bytes = arena_init(interner->arena.length + 64);
+  if (encoding == TITLE_ENCODING_PLAIN) {
+    for (uint32_t i = 0; i < node_count; i++) {
+      struct Slice slice = interner->strs.data[sorted[i]];
+      offsets[i] = bytes.length;
+      // Copy the trailing NUL along with the title
+      arena_push(&bytes, arena_get_slice(&interner->arena, slice),
+                 slice.length + 1);
+    }
+    offsets[node_count] = bytes.length;
+    return bytes;
+  }
+
+  uint32_t bucket = 0;
+  const char* previous = NULL;
+  uint32_t previous_length = 0;
+  for (uint32_t i = 0; i < node_count; i++) {
+    struct Slice slice = interner->strs.data[sorted[i]];
+    const char* title = arena_get_slice(&interner->arena, slice);
+    uint32_t length = slice.length;
+
+    if (i % TITLE_BUCKET_SIZE == 0) {
+      offsets[bucket++] = bytes.length;
+      push_varint(&bytes, length);
+      arena_push(&bytes, (void*) title, length);
+    } else {
+      uint32_t shared = 0;
+      uint32_t max_shared =
+          length < previous_length ? length : previous_length;
+      while (shared < max_shared && title[shared] == previous[shared]) {
+        shared++;
+      }
+      push_varint(&bytes, shared);
+      push_varint(&bytes, length - shared);
+      arena_push(&bytes, (void*) (title + shared), length - shared);
+    }
+    previous = title;
+    previous_length = length;
+  }
+  offsets[bucket] = bytes.length;
+  return bytes;
+}
+
+// Counting sort of the edges by source into CSR form, with the ids renumbered
+// through rank unless it is NULL. Duplicate links from the same page are
+// dropped. Edges from before the first title are ignored.
+static uint32_t build_csr(struct VecEdge* edges, uint32_t node_count,
+                          const uint32_t* rank, uint32_t* offsets,
+                          uint32_t* targets) {
+  memset(offsets, 0, (node_count + 1) * sizeof(uint32_t));
+  for (uint32_t i = 0; i < edges->length; i++) {
+    uint32_t from = edges->data[i].from;
+    if (from < node_count) {
+      offsets[(rank != NULL ? rank[from] : from) + 1] += 1;
+    }
+  }
+  for (uint32_t i = 0; i < node_count; i++) {
+    offsets[i + 1] += offsets[i];
+  }
+
+  uint32_t* cursor = malloc((node_count + 1) * sizeof(uint32_t));
+  memcpy(cursor, offsets, (node_count + 1) * sizeof(uint32_t));
+  for (uint32_t i = 0; i < edges->length; i++) {
+    struct Edge edge = edges->data[i];
+    if (edge.from < node_count && rank != NULL) {
+      targets[cursor[rank[edge.from]]++] = rank[edge.to];
+    } else if (edge.from < node_count) {
+      targets[cursor[edge.from]++] = edge.to;
+    }
+  }
+  free(cursor);
+
+  // Sort each adjacency list and compact out duplicates in place
+  uint32_t write = 0;
+  for (uint32_t node = 0; node < node_count; node++) {
+    uint32_t start = offsets[node];
+    uint32_t end = offsets[node + 1];
+    qsort(targets + start, end - start, sizeof(uint32_t), compare_u32);
+    offsets[node] = write;
+    for (uint32_t i = start; i < end; i++) {
+      if (i == start || targets[i] != targets[i - 1]) {
+        targets[write++] = targets[i];
+      }
+    }
+  }
+  offsets[node_count] = write;
+  return write;
+}
+
+// Builds the reverse CSR. Sources are visited in order so every reversed
+// list comes out sorted.
+static void transpose_csr(uint32_t node_count, const uint32_t* offsets,
+                          const uint32_t* targets, uint32_t* in_offsets,
+                          uint32_t* in_targets) {
+  memset(in_offsets, 0, (node_count + 1) * sizeof(uint32_t));
+  for (uint32_t i = 0; i < offsets[node_count]; i++) {
+    in_offsets[targets[i] + 1] += 1;
+  }
+  for (uint32_t i = 0; i < node_count; i++) {
+    in_offsets[i + 1] += in_offsets[i];
+  }
+  uint32_t* cursor = malloc((node_count + 1) * sizeof(uint32_t));
+  memcpy(cursor, in_offsets, (node_count + 1) * sizeof(uint32_t));
+  for (uint32_t node = 0; node < node_count; node++) {
+    for (uint32_t i = offsets[node]; i < offsets[node + 1]; i++) {
+      in_targets[cursor[targets[i]]++] = node;
+    }
+  }
+  free(cursor);
+}
+
+int graph_write(const char* path, struct Interner* interner,
+                struct VecEdge* edges, const struct BuildOptions* options) {
+  uint32_t node_count = interner->strs.length;
+  // Views read titles into TITLE_MAX_LENGTH scratch buffers
+  for (uint32_t i = 0; i < node_count; i++) {
+    if (interner->strs.data[i].length >= TITLE_MAX_LENGTH) {
+      log_error("Title %u is %u bytes, at most %u fit in a graph file\n", i,
+                interner->strs.data[i].length, TITLE_MAX_LENGTH - 1);
+      return 1;
+    }
+  }
+  uint32_t* sorted = sort_title_ids(interner);
+  uint32_t* rank = malloc((node_count + 1) * sizeof(uint32_t));
+  for (uint32_t i = 0; i < node_count; i++) {
+    rank[sorted[i]] = i;
+  }
+
+  uint32_t* title_offsets = malloc((node_count + 1) * sizeof(uint32_t));
+  struct Arena title_bytes =
+      encode_titles(interner, sorted, options->title_encoding, title_offsets);
+  uint32_t title_offsets_count =
+      options->title_encoding == TITLE_ENCODING_FRONT_CODED
+          ? (node_count + TITLE_BUCKET_SIZE - 1) / TITLE_BUCKET_SIZE + 1
+          : node_count + 1;
+  log_info("\nTitle table: %u bytes for %u bytes of titles\n",
+           title_bytes.length +
+               title_offsets_count * (uint32_t) sizeof(uint32_t),
+           interner->arena.length + interner->strs.length *
+                                        (uint32_t) sizeof(struct Slice));
+
+  uint32_t* out_offsets = malloc((node_count + 1) * sizeof(uint32_t));
+  uint32_t* out_targets = malloc((edges->length + 1) * sizeof(uint32_t));
+  uint32_t edge_count =
+      build_csr(edges, node_count, rank, out_offsets, out_targets);
+  uint32_t* in_offsets = malloc((node_count + 1) * sizeof(uint32_t));
+  uint32_t* in_targets = malloc((edge_count + 1) * sizeof(uint32_t));
+  transpose_csr(node_count, out_offsets, out_targets, in_offsets, in_targets);
+
+  uint32_t* scc_ids = malloc((node_count + 1) * sizeof(uint32_t));
+  uint32_t component_count =
+      scc_tarjan(node_count, out_offsets, out_targets, scc_ids);
+  struct VecEdge cross_edges =
+      scc_cross_edges(node_count, out_offsets, out_targets, scc_ids);
+  uint32_t* dag_offsets = malloc((component_count + 1) * sizeof(uint32_t));
+  uint32_t* dag_targets = malloc((cross_edges.length + 1) * sizeof(uint32_t));
+  uint32_t dag_edge_count = build_csr(&cross_edges, component_count, NULL,
+                                      dag_offsets, dag_targets);
+  free(cross_edges.data);
+  uint8_t* scc_flags = malloc(component_count + 1);
+  for (uint32_t c = 0; c < component_count; c++) {
+    scc_flags[c] = SCC_FLAG_SOURCE;
+    if (dag_offsets[c] == dag_offsets[c + 1]) {
+      scc_flags[c] |= SCC_FLAG_SINK;
+    }
+  }
+  for (uint32_t i = 0; i < dag_edge_count; i++) {
+    scc_flags[dag_targets[i]] &= ~SCC_FLAG_SOURCE;
+  }
+  log_info("Found %u strongly connected components, %u DAG edges\n",
+           component_count, dag_edge_count);
+
+  struct GraphHeader header = {
+      .magic = GRAPH_MAGIC,
+      .version = GRAPH_VERSION,
+      .node_count = node_count,
+      .edge_count = edge_count,
+      .title_encoding = options->title_encoding,
+      .title_bucket_size = TITLE_BUCKET_SIZE,
+      .component_count = component_count,
+      .dag_edge_count = dag_edge_count,
+  };
+  const void* section_data[GRAPH_SECTION_COUNT] = {
+      [GRAPH_SECTION_TITLE_OFFSETS] = title_offsets,
+      [GRAPH_SECTION_TITLE_BYTES] = title_bytes.data,
+      [GRAPH_SECTION_OUT_OFFSETS] = out_offsets,
+      [GRAPH_SECTION_OUT_TARGETS] = out_targets,
+      [GRAPH_SECTION_IN_OFFSETS] = in_offsets,
+      [GRAPH_SECTION_IN_TARGETS] = in_targets,
+      [GRAPH_SECTION_SCC_IDS] = scc_ids,
+      [GRAPH_SECTION_SCC_DAG_OFFSETS] = dag_offsets,
+      [GRAPH_SECTION_SCC_DAG_TARGETS] = dag_targets,
+      [GRAPH_SECTION_SCC_FLAGS] = scc_flags,
+  };
+  header.sections[GRAPH_SECTION_TITLE_OFFSETS].length =
+      title_offsets_count * sizeof(uint32_t);
+  header.sections[GRAPH_SECTION_TITLE_BYTES].length = title_bytes.length;
+  header.sections[GRAPH_SECTION_OUT_OFFSETS].length =
+      (node_count + 1) * sizeof(uint32_t);
+  header.sections[GRAPH_SECTION_OUT_TARGETS].length =
+      (uint64_t) edge_count * sizeof(uint32_t);
+  header.sections[GRAPH_SECTION_IN_OFFSETS].length =
+      (node_count + 1) * sizeof(uint32_t);
+  header.sections[GRAPH_SECTION_IN_TARGETS].length =
+      (uint64_t) edge_count * sizeof(uint32_t);
+  header.sections[GRAPH_SECTION_SCC_IDS].length =
+      (uint64_t) node_count * sizeof(uint32_t);
+  header.sections[GRAPH_SECTION_SCC_DAG_OFFSETS].length =
+      (component_count + 1) * sizeof(uint32_t);
+  header.sections[GRAPH_SECTION_SCC_DAG_TARGETS].length =
+      (uint64_t) dag_edge_count * sizeof(uint32_t);
+  header.sections[GRAPH_SECTION_SCC_FLAGS].length = component_count;
+
+  int result = section_file_write(path, &header, sizeof(header),
+                                  header.sections, section_data,
+                                  GRAPH_SECTION_COUNT);
+  if (result == 0) {
+    log_info("Wrote %u nodes and %u edges to %s\n", node_count, edge_count,
+             path);
+  }
+
+  free(sorted);
+  free(rank);
+  free(title_offsets);
+  free(title_bytes.data);
+  free(out_offsets);
+  free(out_targets);
+  free(in_offsets);
+  free(in_targets);
+  free(scc_ids);
+  free(dag_offsets);
+  free(dag_targets);
+  free(scc_flags);
+  return result;
+}
+
+int graph_open(struct Graph* graph, const char* path) {
+  struct GraphLoadOptions options = graph_load_default_options();
+  return graph_open_with(graph, path, &options);
+}
+
+int graph_open_with(struct Graph* graph, const char* path,
+                    const struct GraphLoadOptions* options) {
+  memset(graph, 0, sizeof(*graph));
+  size_t length;
+  size_t map_length;
+  void* map = graph_load_map(path, options, &length, &map_length);
+  if (map == NULL) {
+    return 1;
+  }
+
+  const struct GraphHeader* header = map;
+  if (header->magic != GRAPH_MAGIC || header->version != GRAPH_VERSION) {
+    log_error("%s is not a graph file of version %u\n", path, GRAPH_VERSION);
+    munmap(map, map_length);
+    return 1;
+  }
+  if (section_file_check(path, header->sections, GRAPH_SECTION_COUNT,
+                         length) != 0) {
+    munmap(map, map_length);
+    return 1;
+  }
+
+  graph->map = map;
+  graph->map_length = map_length;
+  graph->header = header;
+  graph->node_count = header->node_count;
+  graph->edge_count = header->edge_count;
+  graph->titles = (struct InternerView) {
+      .offsets = graph_section(graph, GRAPH_SECTION_TITLE_OFFSETS),
+      .bytes = graph_section(graph, GRAPH_SECTION_TITLE_BYTES),
+      .length = header->node_count,
+      .encoding = header->title_encoding,
+      .bucket_size = header->title_bucket_size,
+  };
+  graph->out_offsets = graph_section(graph, GRAPH_SECTION_OUT_OFFSETS);
+  graph->out_targets = graph_section(graph, GRAPH_SECTION_OUT_TARGETS);
+  graph->in_offsets = graph_section(graph, GRAPH_SECTION_IN_OFFSETS);
+  graph->in_targets = graph_section(graph, GRAPH_SECTION_IN_TARGETS);
+  graph->component_count = header->component_count;
+  graph->scc_ids = graph_section(graph, GRAPH_SECTION_SCC_IDS);
+  graph->dag_offsets = graph_section(graph, GRAPH_SECTION_SCC_DAG_OFFSETS);
+  graph->dag_targets = graph_section(graph, GRAPH_SECTION_SCC_DAG_TARGETS);
+  graph->scc_flags = graph_section(graph, GRAPH_SECTION_SCC_FLAGS);
+  return 0;
+}
+
+void graph_close(struct Graph* graph) {
+  if (graph->map != NULL) {
+    munmap(graph->map, graph->map_length);
+  }
+  memset(graph, 0, sizeof(*graph));
+}
+
+const void* graph_section(const struct Graph* graph, enum GraphSectionId id) {
+  return (const char*) graph->map + graph->header->sections[id].offset;
+}
@@ -0,0 +1,185 @@
+#include "header.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Getting a graph file into memory before the first query. A plain mmap
+// leaves every page to be faulted in by whichever query touches it first,
+// which after a restart means thousands of major faults in the tail latency.
+
+#define HUGE_PAGE_SIZE (2UL << 20)
+#define SMALL_PAGE_SIZE 4096UL
+
+struct GraphLoadOptions graph_load_default_options() {
+  return (struct GraphLoadOptions) {
+      .prefault_threads = 0,
+      .lock = 0,
+      .huge_pages = GRAPH_HUGE_PAGES_NONE,
+  };
+}
+
+// Either touches [begin, end) of base or, with an fd, reads that range of the
+// file into it
+struct LoadWorker {
+  char* base;
+  size_t begin;
+  size_t end;
+  int fd;
+  int result;
+};
+
+static void* load_worker_run(void* arg) {
+  struct LoadWorker* worker = arg;
+  if (worker->fd < 0) {
+    // One read per page is enough to fault it in, running several workers
+    // keeps several reads in flight
+    volatile const char* bytes = worker->base;
+    for (size_t i = worker->begin; i < worker->end; i += SMALL_PAGE_SIZE) {
+      (void) bytes[i];
+    }
+    return NULL;
+  }
+  for (size_t offset = worker->begin; offset < worker->end;) {
+    ssize_t got = pread(worker->fd, worker->base + offset,
+                        worker->end - offset, offset);
+    if (got <= 0) {
+      worker->result = 1;
+      break;
+    }
+    offset += got;
+  }
+  return NULL;
+}
+
+static int run_load_workers(char* base, size_t length, int fd,
+                            uint32_t threads) {
+  if (threads == 0) {
+    threads = 1;
+  }
+  if (threads > GRAPH_LOAD_MAX_THREADS) {
+    threads = GRAPH_LOAD_MAX_THREADS;
+  }
+  struct LoadWorker workers[GRAPH_LOAD_MAX_THREADS];
+  pthread_t handles[GRAPH_LOAD_MAX_THREADS];
+  size_t pages = (length + SMALL_PAGE_SIZE - 1) / SMALL_PAGE_SIZE;
+  for (uint32_t i = 0; i < threads; i++) {
+    size_t begin = pages * i / threads * SMALL_PAGE_SIZE;
+    size_t end = pages * (i + 1) / threads * SMALL_PAGE_SIZE;
+    workers[i] = (struct LoadWorker) {
+        .base = base,
+        .begin = begin,
+        .end = end < length ? end : length,
+        .fd = fd,
+    };
+  }
+  for (uint32_t i = 1; i < threads; i++) {
+    pthread_create(&handles[i], NULL, load_worker_run, &workers[i]);
+  }
+  load_worker_run(&workers[0]);
+  int result = workers[0].result;
+  for (uint32_t i = 1; i < threads; i++) {
+    pthread_join(handles[i], NULL);
+    result |= workers[i].result;
+  }
+  return result;
+}
+
+// Anonymous memory for a copy of the file, starting on a huge page boundary
+static char* huge_page_alloc(size_t length, enum GraphHugePages huge_pages,
+                             size_t* map_length) {
+  size_t rounded = (length + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+  if (huge_pages == GRAPH_HUGE_PAGES_EXPLICIT) {
+    void* map = mmap(NULL, rounded, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (map != MAP_FAILED) {
+      *map_length = rounded;
+      return map;
+    }
+    log_error("No explicit huge pages free, see /proc/sys/vm/nr_hugepages. "
+              "Falling back to transparent huge pages\n");
+  }
+
+  // Over allocate by a huge page and trim both ends to align the start
+  char* map = mmap(NULL, rounded + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (map == MAP_FAILED) {
+    return NULL;
+  }
+  char* aligned =
+      (char*) (((uintptr_t) map + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1));
+  if (aligned > map) {
+    munmap(map, aligned - map);
+  }
+  size_t tail = (map + rounded + HUGE_PAGE_SIZE) - (aligned + rounded);
+  if (tail > 0) {
+    munmap(aligned + rounded, tail);
+  }
+  madvise(aligned, rounded, MADV_HUGEPAGE);
+  *map_length = rounded;
+  return aligned;
+}
+
+// Reads the whole file into huge pages with the load threads, the copy is
+// made read only afterwards like the mapping it replaces
+static void* load_huge_page_copy(const char* path,
+                                 const struct GraphLoadOptions* options,
+                                 size_t* length, size_t* map_length) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    log_error("Failed to open %s\n", path);
+    return NULL;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 ||
+      (size_t) st.st_size < sizeof(struct GraphHeader)) {
+    log_error("%s is truncated\n", path);
+    close(fd);
+    return NULL;
+  }
+  char* copy = huge_page_alloc(st.st_size, options->huge_pages, map_length);
+  if (copy == NULL) {
+    log_error("Failed to allocate %lu bytes for %s\n",
+              (unsigned long) st.st_size, path);
+    close(fd);
+    return NULL;
+  }
+  int result =
+      run_load_workers(copy, st.st_size, fd, options->prefault_threads);
+  close(fd);
+  if (result != 0) {
+    log_error("Failed to read %s\n", path);
+    munmap(copy, *map_length);
+    return NULL;
+  }
+  mprotect(copy, *map_length, PROT_READ);
+  *length = st.st_size;
+  return copy;
+}
+
+void* graph_load_map(const char* path, const struct GraphLoadOptions* options,
+                     size_t* length, size_t* map_length) {
+  void* map;
+  if (options->huge_pages != GRAPH_HUGE_PAGES_NONE) {
+    map = load_huge_page_copy(path, options, length, map_length);
+  } else {
+    int map_flags = options->prefault_threads == 1 ? MAP_POPULATE : 0;
+    map = section_file_map(path, sizeof(struct GraphHeader), length,
+                           map_flags);
+    *map_length = *length;
+    if (map != NULL && options->prefault_threads > 1) {
+      madvise(map, *length, MADV_WILLNEED);
+      run_load_workers(map, *length, -1, options->prefault_threads);
+    }
+  }
+
+  if (map != NULL && options->lock && mlock(map, *map_length) != 0) {
+    log_error("Failed to mlock %s, see ulimit -l. Carrying on unlocked\n",
+              path);
+  }
+  return map;
+}
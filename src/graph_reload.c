@@ -0,0 +1,245 @@
+#include "header.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Swapping in a new generation of the graph under running queries.
+//
+// Readers store the epoch they start in into their own slot before loading
+// the current generation, and clear the slot when done. Publishing swaps the
+// generation first and bumps the epoch after, so a reader whose slot holds
+// the new epoch or later has loaded the new generation. Once every slot is
+// idle or at least at that epoch nothing can still hold the old generation,
+// and it is unmapped. Queries are short, so both mappings only live side by
+// side for about as long as the slowest query in flight.
+
+struct FileStamp {
+  uint64_t device;
+  uint64_t inode;
+  uint64_t size;
+  uint64_t mtime_ns;
+};
+
+struct GraphReloader {
+  char* path;
+  struct GraphLoadOptions options;
+  _Atomic(struct GraphGeneration*) current;
+  atomic_uint_fast64_t epoch;
+  atomic_uint_fast64_t reader_epochs[RELOAD_MAX_READERS]; // 0 when idle
+  atomic_uint reader_count;
+  struct FileStamp loaded;
+  struct FileStamp pending; // differs from loaded, waiting for it to settle
+  uint32_t poll_ms;
+  pthread_t watcher;
+  int watching;
+  atomic_int stop;
+};
+
+static int file_stamp(const char* path, struct FileStamp* stamp) {
+  struct stat st;
+  if (stat(path, &st) != 0) {
+    return 1;
+  }
+  *stamp = (struct FileStamp) {
+      .device = st.st_dev,
+      .inode = st.st_ino,
+      .size = st.st_size,
+      .mtime_ns = (uint64_t) st.st_mtim.tv_sec * 1000000000ULL +
+                  st.st_mtim.tv_nsec,
+  };
+  return 0;
+}
+
+static int stamp_equal(const struct FileStamp* a, const struct FileStamp* b) {
+  return a->device == b->device && a->inode == b->inode &&
+         a->size == b->size && a->mtime_ns == b->mtime_ns;
+}
+
+static void generation_free(struct GraphGeneration* generation) {
+  graph_close(&generation->graph);
+  free(generation->previous_ids);
+  free(generation);
+}
+
+struct GraphReloader* graph_reloader_init(
+    const char* path, const struct GraphLoadOptions* options) {
+  struct GraphGeneration* generation = calloc(1, sizeof(*generation));
+  struct FileStamp stamp = {0};
+  file_stamp(path, &stamp);
+  if (graph_open_with(&generation->graph, path, options) != 0) {
+    free(generation);
+    return NULL;
+  }
+  generation->number = 1;
+
+  struct GraphReloader* reloader = calloc(1, sizeof(*reloader));
+  reloader->path = strdup(path);
+  reloader->options = *options;
+  reloader->loaded = stamp;
+  atomic_init(&reloader->current, generation);
+  atomic_init(&reloader->epoch, 1);
+  return reloader;
+}
+
+void graph_reloader_destroy(struct GraphReloader* reloader) {
+  if (reloader->watching) {
+    atomic_store(&reloader->stop, 1);
+    pthread_join(reloader->watcher, NULL);
+  }
+  generation_free(atomic_load(&reloader->current));
+  free(reloader->path);
+  free(reloader);
+}
+
+uint32_t graph_reloader_register(struct GraphReloader* reloader) {
+  // Only counts up on success, so failed calls never push the count past the
+  // slots publish walks
+  uint32_t reader = atomic_load(&reloader->reader_count);
+  do {
+    if (reader >= RELOAD_MAX_READERS) {
+      log_error("At most %u readers per graph reloader\n",
+                RELOAD_MAX_READERS);
+      return UINT32_MAX;
+    }
+  } while (!atomic_compare_exchange_weak(&reloader->reader_count, &reader,
+                                         reader + 1));
+  return reader;
+}
+
+const struct GraphGeneration* graph_reloader_enter(
+    struct GraphReloader* reloader, uint32_t reader) {
+  atomic_store(&reloader->reader_epochs[reader],
+               atomic_load(&reloader->epoch));
+  return atomic_load(&reloader->current);
+}
+
+void graph_reloader_exit(struct GraphReloader* reloader, uint32_t reader) {
+  atomic_store_explicit(&reloader->reader_epochs[reader], 0,
+                        memory_order_release);
+}
+
+static int compare_strs(struct Str a, struct Str b) {
+  int result =
+      memcmp(a.data, b.data, a.length < b.length ? a.length : b.length);
+  if (result != 0) {
+    return result;
+  }
+  return (a.length > b.length) - (a.length < b.length);
+}
+
+// Both generations have their titles sorted, so one merge of the two lists
+// matches up every page
+static uint32_t* map_previous_ids(const struct Graph* previous,
+                                  const struct Graph* next) {
+  uint32_t* ids = malloc((previous->node_count + 1) * sizeof(uint32_t));
+  char previous_scratch[TITLE_MAX_LENGTH];
+  char next_scratch[TITLE_MAX_LENGTH];
+  uint32_t j = 0;
+  struct Str next_title = {0};
+  if (next->node_count > 0) {
+    next_title = interner_view_get(&next->titles, 0, next_scratch);
+  }
+  for (uint32_t i = 0; i < previous->node_count; i++) {
+    struct Str title =
+        interner_view_get(&previous->titles, i, previous_scratch);
+    int cmp = 1;
+    while (j < next->node_count &&
+           (cmp = compare_strs(next_title, title)) < 0) {
+      if (++j < next->node_count) {
+        next_title = interner_view_get(&next->titles, j, next_scratch);
+      }
+    }
+    ids[i] = j < next->node_count && cmp == 0 ? j : UINT32_MAX;
+  }
+  return ids;
+}
+
+// Waits out every reader that may have loaded the old generation
+static void publish(struct GraphReloader* reloader,
+                    struct GraphGeneration* next) {
+  struct GraphGeneration* old = atomic_exchange(&reloader->current, next);
+  uint64_t epoch = atomic_fetch_add(&reloader->epoch, 1) + 1;
+  uint32_t readers = atomic_load(&reloader->reader_count);
+  for (uint32_t i = 0; i < readers; i++) {
+    // Still waits after the warning, unmapping under a reader would crash it
+    for (uint64_t waited_us = 0;; waited_us += 100) {
+      uint64_t reader_epoch = atomic_load(&reloader->reader_epochs[i]);
+      if (reader_epoch == 0 || reader_epoch >= epoch) {
+        break;
+      }
+      if (waited_us == RELOAD_WAIT_WARN_MS * 1000ULL) {
+        log_error("Reader %u has held generation %lu for over %u ms, "
+                  "generation %lu waits for it to exit\n",
+                  i, old->number, RELOAD_WAIT_WARN_MS, next->number);
+      }
+      usleep(100);
+    }
+  }
+  generation_free(old);
+}
+
+int graph_reloader_poll(struct GraphReloader* reloader) {
+  struct FileStamp stamp;
+  if (file_stamp(reloader->path, &stamp) != 0 ||
+      stamp_equal(&stamp, &reloader->loaded)) {
+    memset(&reloader->pending, 0, sizeof(reloader->pending));
+    return 0;
+  }
+  // A file written in place rather than renamed over the old one changes
+  // between polls until it's done
+  if (!stamp_equal(&stamp, &reloader->pending)) {
+    reloader->pending = stamp;
+    return 0;
+  }
+  // Not retried until the file changes again, even when it fails to open
+  reloader->loaded = stamp;
+  struct GraphGeneration* next = calloc(1, sizeof(*next));
+  if (graph_open_with(&next->graph, reloader->path, &reloader->options) != 0) {
+    log_error("Keeping the current graph\n");
+    free(next);
+    return 0;
+  }
+  // Only this thread publishes, so current can't change under it
+  const struct GraphGeneration* previous = atomic_load(&reloader->current);
+  next->number = previous->number + 1;
+  next->previous_node_count = previous->graph.node_count;
+  next->previous_ids = map_previous_ids(&previous->graph, &next->graph);
+  uint32_t kept = 0;
+  for (uint32_t i = 0; i < previous->graph.node_count; i++) {
+    kept += next->previous_ids[i] != UINT32_MAX;
+  }
+  log_info("Loaded generation %lu of %s: %u nodes, %u edges, %u of %u pages "
+           "carried over\n",
+           next->number, reloader->path, next->graph.node_count,
+           next->graph.edge_count, kept, previous->graph.node_count);
+  publish(reloader, next);
+  return 1;
+}
+
+static void* watcher_run(void* arg) {
+  struct GraphReloader* reloader = arg;
+  while (!atomic_load(&reloader->stop)) {
+    graph_reloader_poll(reloader);
+    // Short sleeps so stopping doesn't wait out a long interval
+    for (uint32_t waited = 0;
+         waited < reloader->poll_ms && !atomic_load(&reloader->stop);
+         waited += 10) {
+      usleep(10000);
+    }
+  }
+  return NULL;
+}
+
+int graph_reloader_watch(struct GraphReloader* reloader, uint32_t poll_ms) {
+  reloader->poll_ms = poll_ms;
+  if (pthread_create(&reloader->watcher, NULL, watcher_run, reloader) != 0) {
+    log_error("Failed to start the graph watcher\n");
+    return 1;
+  }
+  reloader->watching = 1;
+  return 0;
+}
@@ -71,6 +71,71 @@ struct Interner interner_init(uint32_t capacity);
 void interner_destroy(struct Interner* interner);
 void interner_set_arena_context(struct Arena* arena);
 uint32_t intern_from_cstr(struct Interner* interner, const char* s, size_t len);
+
+// Longer link targets can't be titles and are dropped by the parser, and
+// graph_write rejects longer page titles, so both encodings hold every title
+// whole and in the same order
+#define TITLE_MAX_LENGTH 512
+#define TITLE_BUCKET_SIZE 16 // Titles per front coded bucket
+
+enum TitleEncoding {
+  TITLE_ENCODING_PLAIN,
+  // Sorted titles in buckets, each title stores the length of the prefix it
+  // shares with the previous one and only the remaining suffix
+  TITLE_ENCODING_FRONT_CODED,
+};
+
+// Read only interner over the title sections of a mapped graph file. Titles
+// are sorted, so ids are ranks in byte order. For PLAIN, offsets has one entry
+// per title, for FRONT_CODED one per bucket.
+struct InternerView {
+  const uint32_t* offsets;
+  const char* bytes;
+  uint32_t length;
+  enum TitleEncoding encoding;
+  uint32_t bucket_size;
+};
+
+// Returns the title of id. PLAIN titles point straight into the mapping and
+// must not be written through, FRONT_CODED titles are decoded into scratch,
+// which must hold TITLE_MAX_LENGTH bytes. Both are NUL terminated.
+struct Str interner_view_get(const struct InternerView* view, uint32_t id,
+                             char* scratch);
+// Returns the id of the title, or UINT32_MAX when it isn't in the view
+uint32_t interner_view_find(const struct InternerView* view, const char* s,
+                            size_t len);
+
+// ====== Concurrent interner ===== //
+
+#define CONCURRENT_INTERNER_SHARDS 64
+#define CONCURRENT_INTERNER_CHUNK_BITS 16 // ids per chunk of the id table
+#define CONCURRENT_INTERNER_MAX_CHUNKS (1 << 16)
+
+// Thread safe interner, ids are unique across all threads but their order
+// depends on scheduling. Not used by build_graph yet, which still parses on
+// one thread into the plain Interner; it is the building block for a
+// parallel parse and is only exercised by the tests and the bench for now
+struct ConcurrentInterner;
+
+// Per thread handle, owns the arena block the thread copies strings into
+struct InternerLocal {
+  struct ConcurrentInterner* interner;
+  char* block;
+  size_t used;
+  size_t capacity;
+};
+
+struct ConcurrentInterner* concurrent_interner_init(uint32_t capacity);
+void concurrent_interner_destroy(struct ConcurrentInterner* interner);
+struct InternerLocal interner_local_init(struct ConcurrentInterner* interner);
+uint32_t concurrent_intern(struct InternerLocal* local, const char* s,
+                           size_t len);
+// The id must have been returned to this thread, or handed over with proper
+// synchronisation. The string is NUL terminated.
+struct Str concurrent_interner_get(struct ConcurrentInterner* interner,
+                                   uint32_t id);
+uint32_t concurrent_interner_length(struct ConcurrentInterner* interner);
+
 // Ultra simple progess bar
 void print_progress(size_t count, size_t max);
 
@@ -98,8 +163,617 @@ char* parse_links(struct Str* buf, struct Interner* interner,
 char* parse_buffer(struct Str* buf, struct Interner* interner,
                    struct VecEdge* edges, uint32_t* from_id);
 
-int build_graph();
+// Which links of a page make it into the graph. Players mostly click links
+// near the top of a page, so graphs of only those are smaller and faster.
+struct LinkLimits {
+  uint32_t max_links; // per page, 0 for all of them
+  int lead_only;      // stop at the first section heading
+};
+
+// What the parser knows about the page it is in, kept from one read of the
+// dump to the next
+struct ParseState {
+  uint32_t from_id;
+  int in_text;         // the page's text runs on past the end of the buffer
+  int skipping;        // past the page's limits, only looking for </text>
+  uint32_t link_count; // of the page so far
+};
+
+// As parse_links and parse_buffer, skipping to </text> once the limits are
+// hit. parse_buffer_with returns the tail to carry over to the next read, or
+// NULL when there is none. parse_buffer starts every call outside of a text.
+char* parse_links_with(struct Str* buf, struct Interner* interner,
+                       struct VecEdge* edges, struct ParseState* state,
+                       const struct LinkLimits* limits);
+char* parse_buffer_with(struct Str* buf, struct Interner* interner,
+                        struct VecEdge* edges, struct ParseState* state,
+                        const struct LinkLimits* limits);
+
+struct BuildOptions {
+  enum TitleEncoding title_encoding;
+  struct LinkLimits link_limits;
+  const char* output_path; // used by build_graph
+};
+
+struct BuildOptions build_options_default();
+int build_graph(const struct BuildOptions* options);
 int build_graph_inner(FILE* xml_file, uint64_t buff_size,
                       struct Interner* interner, struct VecEdge* edges,
-                      char* output_path);
+                      char* output_path, const struct BuildOptions* options);
+
+// ====== Graph file ===== //
+
+#define GRAPH_MAGIC 0x48505247 // "GRPH"
+#define GRAPH_VERSION 4
+#define GRAPH_SECTION_ALIGN 64
+#define GRAPH_MAX_SECTIONS 16
+
+enum GraphSectionId {
+  GRAPH_SECTION_TITLE_OFFSETS,
+  GRAPH_SECTION_TITLE_BYTES,
+  GRAPH_SECTION_OUT_OFFSETS,
+  GRAPH_SECTION_OUT_TARGETS,
+  GRAPH_SECTION_IN_OFFSETS,
+  GRAPH_SECTION_IN_TARGETS,
+  GRAPH_SECTION_SCC_IDS,
+  GRAPH_SECTION_SCC_DAG_OFFSETS,
+  GRAPH_SECTION_SCC_DAG_TARGETS,
+  GRAPH_SECTION_SCC_FLAGS,
+  GRAPH_SECTION_COUNT,
+};
+
+struct GraphSection {
+  uint64_t offset;
+  uint64_t length;
+};
+
+struct GraphHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t node_count;
+  uint32_t edge_count;
+  uint32_t title_encoding;
+  uint32_t title_bucket_size;
+  uint32_t component_count;
+  uint32_t dag_edge_count;
+  struct GraphSection sections[GRAPH_MAX_SECTIONS];
+};
+
+// Writes header followed by the sections, filling in each section's offset.
+// The file replaces path atomically.
+int section_file_write(const char* path, const void* header,
+                       size_t header_size, struct GraphSection* sections,
+                       const void* const* data, int count);
+// Maps a file written by section_file_write, returns NULL on failure
+void* section_file_map(const char* path, size_t header_size, size_t* length,
+                       int map_flags);
+int section_file_check(const char* path, const struct GraphSection* sections,
+                       int count, size_t length);
+
+// A graph file mapped read only. Node ids are the ranks of the titles in
+// sorted order, not the interner ids of the build.
+struct Graph {
+  void* map;
+  size_t map_length;
+  const struct GraphHeader* header;
+  uint32_t node_count;
+  uint32_t edge_count;
+  struct InternerView titles;
+  const uint32_t* out_offsets;
+  const uint32_t* out_targets;
+  const uint32_t* in_offsets;
+  const uint32_t* in_targets;
+  // Strongly connected components, see scc_tarjan for the numbering
+  uint32_t component_count;
+  const uint32_t* scc_ids;
+  const uint32_t* dag_offsets;
+  const uint32_t* dag_targets;
+  const uint8_t* scc_flags;
+};
+
+enum GraphHugePages {
+  GRAPH_HUGE_PAGES_NONE,
+  // Copy into anonymous memory marked MADV_HUGEPAGE
+  GRAPH_HUGE_PAGES_TRANSPARENT,
+  // Copy into MAP_HUGETLB memory, needs pages reserved in
+  // /proc/sys/vm/nr_hugepages and falls back to TRANSPARENT without them
+  GRAPH_HUGE_PAGES_EXPLICIT,
+};
+
+// How graph_open_with gets the file into memory before the first query
+struct GraphLoadOptions {
+  // Threads faulting the file in up front, 0 leaves it to the first queries.
+  // One thread uses MAP_POPULATE, more touch a page each in parallel after
+  // madvise(MADV_WILLNEED).
+  uint32_t prefault_threads;
+  int lock; // mlock the graph, failing that it carries on unlocked
+  enum GraphHugePages huge_pages;
+};
+
+#define GRAPH_LOAD_MAX_THREADS 64
+
+// Writes the interned titles sorted and the edges in CSR form, returns 0 on
+// success
+int graph_write(const char* path, struct Interner* interner,
+                struct VecEdge* edges, const struct BuildOptions* options);
+struct GraphLoadOptions graph_load_default_options();
+// Maps or copies the file as the options ask, returns NULL on failure. length
+// is the size of the file, map_length the size to munmap.
+void* graph_load_map(const char* path, const struct GraphLoadOptions* options,
+                     size_t* length, size_t* map_length);
+int graph_open(struct Graph* graph, const char* path);
+int graph_open_with(struct Graph* graph, const char* path,
+                    const struct GraphLoadOptions* options);
+void graph_close(struct Graph* graph);
+const void* graph_section(const struct Graph* graph, enum GraphSectionId id);
+
+// ====== Strongly connected components ===== //
+
+#define SCC_FLAG_SOURCE 1 // no edges in from other components
+#define SCC_FLAG_SINK 2   // no edges out to other components
+
+enum Reachability {
+  REACHABILITY_NO,
+  REACHABILITY_YES,
+  REACHABILITY_UNKNOWN,
+};
+
+// Writes the component of each node and returns the number of components.
+// Component ids are a reverse topological order of the condensation DAG.
+uint32_t scc_tarjan(uint32_t node_count, const uint32_t* offsets,
+                    const uint32_t* targets, uint32_t* component);
+struct VecEdge scc_cross_edges(uint32_t node_count, const uint32_t* offsets,
+                               const uint32_t* targets,
+                               const uint32_t* component);
+// O(1) answer from the component index alone, UNKNOWN needs a search
+enum Reachability graph_reachability(const struct Graph* graph,
+                                     uint32_t source, uint32_t target);
+
+// ====== Search ===== //
+
+#define SEARCH_MAX_PATH 256 // Nodes, far above the diameter of the graph
+// A prefetch distance to opt in with, see SearchState
+#define SEARCH_PREFETCH_DISTANCE 4
+
+// Limits on the paths a search may return
+struct SearchConstraints {
+  // Bitmap of node_count bits, the path may not pass through or end at a set
+  // node. NULL for none, must not change while the constraints are set.
+  const uint64_t* banned;
+  uint32_t max_hops; // edges in the path, at most SEARCH_MAX_PATH - 1
+};
+
+// Per thread scratch for queries, sized for one graph
+struct SearchState {
+  uint32_t* parent;
+  uint32_t* queue;
+  uint64_t* visited;
+  uint32_t nodes_visited; // of the last query
+  // Frontier nodes prefetched ahead of the one being expanded. 0, the
+  // default, is the plain kernel; every distance measured 2-3% slower on the
+  // bench's power law graph, see bench prefetch -g for a real one
+  uint32_t prefetch_distance;
+  struct SearchConstraints constraints;
+};
+
+struct SearchState search_state_init(const struct Graph* graph);
+void search_state_destroy(struct SearchState* state);
+struct SearchConstraints search_constraints_none();
+// Applies to every search with the state until changed. Banned nodes are
+// copied into the visited bits up front, so the search skips them for free;
+// switching the bitmap costs a copy of it, hop limits alone cost nothing.
+void search_state_constrain(struct SearchState* state,
+                            const struct Graph* graph,
+                            const struct SearchConstraints* constraints);
+// Breadth first search for a shortest path. Writes the nodes of the path into
+// path, which must hold SEARCH_MAX_PATH nodes, and returns how many there are.
+// Returns 0 when target can't be reached from source within the constraints
+// of the state.
+uint32_t search_shortest_path(const struct Graph* graph,
+                              struct SearchState* state, uint32_t source,
+                              uint32_t target, uint32_t* path);
+
+// ====== Node masks ===== //
+
+#define MASK_MAGIC 0x4b53414d // "MASK"
+#define MASK_VERSION 1
+#define MASK_MAX_COUNT 64
+#define MASK_NAME_MAX 64
+
+enum MaskSectionId {
+  MASK_SECTION_NAMES,
+  MASK_SECTION_BITS,
+  MASK_SECTION_COUNT,
+};
+
+struct MaskHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t node_count; // of the graph the masks were built from
+  uint32_t edge_count;
+  uint32_t mask_count;
+  uint32_t words; // uint64 per mask
+  struct GraphSection sections[MASK_SECTION_COUNT];
+};
+
+enum NodeMaskKind {
+  NODE_MASK_TITLE,    // titles matching a glob, e.g. "List of *"
+  NODE_MASK_CATEGORY, // pages in a category whose name matches a glob
+};
+
+struct NodeMaskSpec {
+  char name[MASK_NAME_MAX];
+  enum NodeMaskKind kind;
+  const char* pattern; // fnmatch(3) glob, not copied
+};
+
+// Named node bitmaps built alongside a graph, mapped read only
+struct NodeMasks {
+  void* map;
+  size_t map_length;
+  const struct MaskHeader* header;
+  uint32_t count;
+  uint32_t words;
+  const char (*names)[MASK_NAME_MAX];
+  const uint64_t* bits;
+};
+
+// Parses name=title:GLOB or name=category:GLOB, pattern points into arg
+int node_mask_spec_parse(struct NodeMaskSpec* spec, const char* arg);
+// Fills specs with the masks built when none are named, returns how many
+uint32_t node_mask_default_specs(struct NodeMaskSpec* specs);
+int node_masks_build(const struct Graph* graph, const char* path,
+                     const struct NodeMaskSpec* specs, uint32_t count);
+int node_masks_open(struct NodeMasks* masks, const char* path,
+                    const struct Graph* graph);
+void node_masks_close(struct NodeMasks* masks);
+// Returns the bits of the named mask, NULL when there isn't one
+const uint64_t* node_masks_find(const struct NodeMasks* masks,
+                                const char* name, size_t length);
+// Combines masks into out, which holds masks->words uint64. The expression
+// ORs terms of names ANDed with &, a ! in front of a name negates it, e.g.
+// "lists|dates|people&!living". Returns 0 on success.
+int node_masks_compile(const struct NodeMasks* masks, const char* expression,
+                       uint64_t* out);
+
+// ====== Query cache ===== //
+
+#define QUERY_CACHE_MISS UINT32_MAX
+
+struct QueryCacheOptions {
+  // Reverse BFS trees of hot targets, each costs 5 bytes per node
+  size_t tree_budget_bytes;
+  // Queries to a target before a tree is built for it
+  uint32_t tree_admit_after;
+  // LRU cache of source, target pairs and their paths, bucket array included
+  size_t pair_budget_bytes;
+};
+
+struct QueryCacheStats {
+  uint64_t lookups;
+  uint64_t tree_hits;
+  uint64_t pair_hits;
+  uint64_t trees_built;
+  uint64_t tree_evictions;
+  uint64_t pair_evictions;
+  size_t tree_bytes;
+  size_t pair_bytes; // entries and the bucket array
+};
+
+struct QueryCache;
+
+struct QueryCacheOptions query_cache_default_options();
+struct QueryCache* query_cache_init(const struct Graph* graph,
+                                    const struct QueryCacheOptions* options);
+void query_cache_destroy(struct QueryCache* cache);
+// Same contract as search_shortest_path, or QUERY_CACHE_MISS when neither a
+// tree nor a pair is cached. Never builds a tree, a target that turned hot is
+// queued for query_cache_build_trees.
+uint32_t query_cache_lookup(struct QueryCache* cache, uint32_t source,
+                            uint32_t target, uint32_t* path);
+// Builds the trees of the queued targets, one BFS over the graph each. Meant
+// to run between queries, after the answer went out. Returns how many were
+// built.
+uint32_t query_cache_build_trees(struct QueryCache* cache);
+// Remembers the answer to a missed lookup, length 0 for no path
+void query_cache_insert(struct QueryCache* cache, uint32_t source,
+                        uint32_t target, const uint32_t* path,
+                        uint32_t length);
+struct QueryCacheStats query_cache_stats(const struct QueryCache* cache);
+// Moves the cache over to the next generation of the graph and destroys the
+// old one. ids maps every node the cache was built for to its id in graph,
+// UINT32_MAX for pages that are gone. Target counts carry over, so hot
+// targets are queued for their trees again on their next lookup. Cached paths
+// are kept when every page and link on them still exists, they are not
+// checked for being shortest again.
+struct QueryCache* query_cache_translate(struct QueryCache* cache,
+                                         const struct Graph* graph,
+                                         const uint32_t* ids);
+
+// ====== Graph reload ===== //
+
+#define RELOAD_MAX_READERS 64
+// Publishing logs a reader that keeps the old generation mapped this long
+#define RELOAD_WAIT_WARN_MS 1000
+
+struct GraphGeneration {
+  struct Graph graph;
+  uint64_t number; // 1 for the graph the reloader was started with
+  // Id in this generation of every node of the previous one, UINT32_MAX for
+  // pages that are gone. NULL for the first generation.
+  uint32_t* previous_ids;
+  uint32_t previous_node_count;
+};
+
+// Watches a graph file and publishes a new generation when it is replaced,
+// unmapping the old one once no reader can still be using it
+struct GraphReloader;
+
+struct GraphReloader* graph_reloader_init(
+    const char* path, const struct GraphLoadOptions* options);
+// No reader may be inside when destroying
+void graph_reloader_destroy(struct GraphReloader* reloader);
+// Polls the file every poll_ms on a thread of its own
+int graph_reloader_watch(struct GraphReloader* reloader, uint32_t poll_ms);
+// One check of the file, what the watcher runs. A changed file is loaded once
+// it looks the same on two polls in a row. Blocks until readers of the old
+// generation are done and returns 1 when a new one was published.
+int graph_reloader_poll(struct GraphReloader* reloader);
+// A slot for one reader thread, UINT32_MAX when there are none left
+uint32_t graph_reloader_register(struct GraphReloader* reloader);
+// The generation stays mapped until the matching exit. A reader that was idle
+// across more than one reload sees the number jump by more than one, and the
+// previous ids are relative to a generation it never saw.
+const struct GraphGeneration* graph_reloader_enter(
+    struct GraphReloader* reloader, uint32_t reader);
+void graph_reloader_exit(struct GraphReloader* reloader, uint32_t reader);
+
+// ====== Landmark labels ===== //
+
+#define LABEL_MAGIC 0x4c42414c // "LABL"
+#define LABEL_VERSION 1
+
+enum LabelSectionId {
+  LABEL_SECTION_OUT_OFFSETS,
+  LABEL_SECTION_OUT_HUBS,
+  LABEL_SECTION_OUT_DISTS,
+  LABEL_SECTION_IN_OFFSETS,
+  LABEL_SECTION_IN_HUBS,
+  LABEL_SECTION_IN_DISTS,
+  LABEL_SECTION_COUNT,
+};
+
+struct LabelHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t node_count; // of the graph the labels were built from
+  uint32_t edge_count;
+  uint64_t out_entries;
+  uint64_t in_entries;
+  struct GraphSection sections[LABEL_SECTION_COUNT];
+};
+
+// 2-hop cover distance index over a graph, mapped read only
+struct LabelIndex {
+  void* map;
+  size_t map_length;
+  const struct LabelHeader* header;
+  const uint64_t* out_offsets;
+  const uint32_t* out_hubs;
+  const uint8_t* out_dists;
+  const uint64_t* in_offsets;
+  const uint32_t* in_hubs;
+  const uint8_t* in_dists;
+};
+
+// Builds pruned landmark labels for the graph and writes them to path. The
+// forward and backward searches of (threads + 1) / 2 hubs at a time run in
+// parallel. 1 and 2 threads give the same labels, more threads prune a
+// little less and so give somewhat bigger ones.
+int label_index_build(const struct Graph* graph, const char* path,
+                      uint32_t threads);
+int label_index_open(struct LabelIndex* index, const char* path,
+                     const struct Graph* graph);
+void label_index_close(struct LabelIndex* index);
+// Exact distance in hops, UINT32_MAX when unreachable
+uint32_t label_distance(const struct LabelIndex* index, uint32_t source,
+                        uint32_t target);
+// Same contract as search_shortest_path, guided by label distances
+uint32_t label_shortest_path(const struct Graph* graph,
+                             const struct LabelIndex* index, uint32_t source,
+                             uint32_t target, uint32_t* path);
+
+// ====== Partitioned graph ===== //
+
+#define SHARD_MAGIC 0x44524853 // "SHRD"
+#define SHARD_VERSION 1
+#define SHARD_MAX_COUNT 256
+
+enum PartitionKind {
+  // Contiguous ranges of node ids holding about the same number of edges
+  PARTITION_RANGE,
+  // Linear deterministic greedy streaming partitioner, puts each node in the
+  // shard holding most of its neighbours, weighted against the shard's size
+  PARTITION_GREEDY,
+};
+
+enum ShardSectionId {
+  SHARD_SECTION_NODES,
+  SHARD_SECTION_OUT_OFFSETS,
+  SHARD_SECTION_OUT_TARGETS,
+  SHARD_SECTION_OWNERS,
+  SHARD_SECTION_LOCAL_IDS,
+  SHARD_SECTION_COUNT,
+};
+
+struct ShardHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t partition;
+  uint32_t shard_index;
+  uint32_t shard_count;
+  uint32_t node_count; // of the whole graph
+  uint32_t local_node_count;
+  uint32_t local_edge_count;
+  struct GraphSection sections[SHARD_SECTION_COUNT];
+};
+
+// One shard of a partitioned graph, mapped read only. It holds the out edges
+// of the nodes it owns, plus the owner and local id of every node in the graph
+// so it can route edges to other shards.
+struct Shard {
+  void* map;
+  size_t map_length;
+  const struct ShardHeader* header;
+  uint32_t index;
+  uint32_t count;
+  uint32_t node_count;
+  uint32_t local_node_count;
+  const uint32_t* nodes; // global id of each local node, ascending
+  const uint32_t* out_offsets;
+  const uint32_t* out_targets; // global ids
+  const uint16_t* owners;
+  const uint32_t* local_ids; // in the owning shard
+};
+
+// Writes the graph as shard_count files named <prefix>.<index>, returns 0 on
+// success
+int partition_graph(const struct Graph* graph, const char* prefix,
+                    uint32_t shard_count, enum PartitionKind kind);
+int shard_open(struct Shard* shard, const char* prefix, uint32_t index);
+void shard_close(struct Shard* shard);
+
+// ====== Transport ===== //
+
+enum TransportKind {
+  TRANSPORT_UNIX_SOCKET,
+  TRANSPORT_SHARED_MEMORY,
+};
+
+// Byte stream between two processes, implemented once per kind of transport
+struct TransportOps {
+  int (*write)(void* impl, const void* data, size_t length);
+  int (*read)(void* impl, void* data, size_t length);
+  // Optional, for transports that can't tell on their own that the peer died
+  void (*watch)(void* impl, int peer);
+  void (*close)(void* impl);
+};
+
+enum ShardMessageType {
+  SHARD_MSG_LEVEL,      // expand one BFS level, edges are incoming candidates
+  SHARD_MSG_CANDIDATES, // edges for the shard in the shard field
+  SHARD_MSG_LEVEL_DONE,
+  SHARD_MSG_PARENT, // asks for, or answers with, the BFS parent of node
+  SHARD_MSG_RESET,
+  SHARD_MSG_EXIT,
+};
+
+// Fixed size message, followed by edge_count edges of (parent, node)
+struct ShardMessage {
+  uint32_t type;
+  uint32_t node;
+  uint32_t shard;
+  uint32_t found;
+  uint32_t visited;
+  uint32_t pending;
+  uint32_t edge_count;
+};
+
+// One end of a connection, messages are framed on top of the byte stream
+struct Transport {
+  const struct TransportOps* ops;
+  void* impl;
+  struct VecEdge received;
+  uint64_t bytes_sent;
+  uint64_t bytes_received;
+};
+
+// Connects two ends, meant to be called before fork with each process keeping
+// one end and closing the other
+int transport_pair(enum TransportKind kind, struct Transport* a,
+                   struct Transport* b);
+int transport_send(struct Transport* transport,
+                   const struct ShardMessage* message,
+                   const struct Edge* edges);
+// The edges stay valid until the next receive
+int transport_recv(struct Transport* transport, struct ShardMessage* message,
+                   const struct Edge** edges);
+// Makes reads and writes that block on the peer process fail once it exits
+void transport_watch(struct Transport* transport, int peer);
+void transport_close(struct Transport* transport);
+
+// ====== Distributed search ===== //
+
+// Coordinator of a level synchronous BFS over one process per shard
+struct DistributedSearch {
+  uint32_t shard_count;
+  struct Transport* transports;
+  int* pids;
+  struct Shard routing; // shard 0, only its owner table is read
+  struct VecEdge* outgoing;
+  uint32_t nodes_visited; // of the last query
+  uint64_t bytes_moved;   // both ways between coordinator and shards
+};
+
+// Forks a server process for each of the shard files at prefix
+int distributed_search_init(struct DistributedSearch* search,
+                            const char* prefix, uint32_t shard_count,
+                            enum TransportKind kind);
+void distributed_search_destroy(struct DistributedSearch* search);
+// Same contract as search_shortest_path
+uint32_t distributed_shortest_path(struct DistributedSearch* search,
+                                   uint32_t source, uint32_t target,
+                                   uint32_t* path);
+// Serves requests from the coordinator until told to exit
+int shard_server_run(const char* prefix, uint32_t index,
+                     struct Transport* transport);
+
+// ====== Multi-source BFS ===== //
+
+#define MSBFS_MAX_SOURCES 512
+#define MSBFS_MAX_WORDS (MSBFS_MAX_SOURCES / 64)
+
+// Runs BFS from up to MSBFS_MAX_SOURCES sources at once, each node holds one
+// bit per source for seen, this level's frontier and the next one
+struct MsBfs {
+  const struct Graph* graph;
+  uint32_t words; // 64 bit words of lanes per node, a power of two
+  uint32_t threads;
+  int reverse; // distances to the sources rather than from them
+  uint64_t* seen;
+  uint64_t* visit;
+  uint64_t* next;
+};
+
+struct MsBfsResult {
+  uint32_t source_count;
+  uint32_t depth; // deepest level any source reached
+  uint64_t histogram[SEARCH_MAX_PATH]; // source, node pairs by distance
+  uint32_t eccentricity[MSBFS_MAX_SOURCES];
+  uint32_t reached[MSBFS_MAX_SOURCES]; // nodes reached, counting the source
+  uint64_t distance_sum[MSBFS_MAX_SOURCES];
+  uint32_t farthest[MSBFS_MAX_SOURCES]; // a node at the eccentricity
+};
+
+// Sized for batches of up to max_sources, rounded up to 64, 128, 256 or 512
+struct MsBfs msbfs_init(const struct Graph* graph, uint32_t max_sources,
+                        uint32_t threads, int reverse);
+void msbfs_destroy(struct MsBfs* msbfs);
+int msbfs_run(struct MsBfs* msbfs, const uint32_t* sources,
+              uint32_t source_count, struct MsBfsResult* result);
+
+// ====== Synthetic dump ===== //
+
+struct SynthDumpOptions {
+  uint32_t page_count;
+  uint32_t mean_links;    // average links per page body
+  uint32_t red_link_pct;  // links to titles that have no page
+  uint32_t template_pct;  // pages with infobox and citation templates
+  uint32_t namespace_pct; // Category:, Template:, File: ... pages
+  uint64_t seed;
+};
+
+struct SynthDumpOptions synth_dump_default_options();
+// Writes a synthetic MediaWiki XML dump, returns 0 on success
+int synth_dump_write(FILE* out, const struct SynthDumpOptions* options);
 #endif
@@ -47,5 +47,144 @@ struct Interner interner_init(uint32_t capacity) {
 }
 
 void interner_destroy(struct Interner* interner) {
-  // TODO: implement this
+  free(interner->arena.data);
+  free(interner->strs.data);
+  interner->arena = (struct Arena) {0};
+  interner->strs = (struct VecSlice) {0};
+}
+
+static uint32_t read_varint(const uint8_t** cursor) {
+  uint32_t value = 0;
+  uint32_t shift = 0;
+  uint8_t byte;
+  do {
+    byte = *(*cursor)++;
+    value |= (uint32_t) (byte & 0x7f) << shift;
+    shift += 7;
+  } while (byte & 0x80);
+  return value;
+}
+
+// Byte order, a prefix sorts before the longer string
+static int compare_titles(const char* a, size_t a_len, const char* b,
+                          size_t b_len) {
+  int result = memcmp(a, b, a_len < b_len ? a_len : b_len);
+  if (result != 0) {
+    return result;
+  }
+  return (a_len > b_len) - (a_len < b_len);
+}
+
+// Walks the titles of one front coded bucket in order, decoding into scratch.
+// The bucket head is stored as length + bytes, the rest as shared prefix
+// length + suffix length + suffix bytes.
+struct BucketCursor {
+  const uint8_t* cursor;
+  char* scratch;
+  uint32_t length;
+};
+
+static struct BucketCursor bucket_cursor_init(const struct InternerView* view,
+                                              uint32_t bucket, char* scratch) {
+  struct BucketCursor bucket_cursor = {
+      .cursor = (const uint8_t*) view->bytes + view->offsets[bucket],
+      .scratch = scratch,
+  };
+  bucket_cursor.length = read_varint(&bucket_cursor.cursor);
+  memcpy(scratch, bucket_cursor.cursor, bucket_cursor.length);
+  bucket_cursor.cursor += bucket_cursor.length;
+  return bucket_cursor;
+}
+
+static void bucket_cursor_next(struct BucketCursor* bucket_cursor) {
+  uint32_t shared = read_varint(&bucket_cursor->cursor);
+  uint32_t suffix = read_varint(&bucket_cursor->cursor);
+  memcpy(bucket_cursor->scratch + shared, bucket_cursor->cursor, suffix);
+  bucket_cursor->cursor += suffix;
+  bucket_cursor->length = shared + suffix;
+}
+
+static struct Str decode_bucket(const struct InternerView* view,
+                                uint32_t bucket, uint32_t index,
+                                char* scratch) {
+  struct BucketCursor bucket_cursor = bucket_cursor_init(view, bucket, scratch);
+  for (uint32_t i = 0; i < index; i++) {
+    bucket_cursor_next(&bucket_cursor);
+  }
+  scratch[bucket_cursor.length] = '\0';
+  return (struct Str) {.data = scratch, .length = bucket_cursor.length};
+}
+
+struct Str interner_view_get(const struct InternerView* view, uint32_t id,
+                             char* scratch) {
+  if (view->encoding == TITLE_ENCODING_FRONT_CODED) {
+    return decode_bucket(view, id / view->bucket_size, id % view->bucket_size,
+                         scratch);
+  }
+  uint32_t offset = view->offsets[id];
+  // Titles are NUL terminated, so the length excludes the trailing byte
+  return (struct Str) {
+      .data = (char*) view->bytes + offset,
+      .length = view->offsets[id + 1] - offset - 1,
+  };
+}
+
+uint32_t interner_view_find(const struct InternerView* view, const char* s,
+                            size_t len) {
+  char scratch[TITLE_MAX_LENGTH];
+  if (view->encoding == TITLE_ENCODING_PLAIN) {
+    uint32_t low = 0;
+    uint32_t high = view->length;
+    while (low < high) {
+      uint32_t mid = low + (high - low) / 2;
+      struct Str title = interner_view_get(view, mid, scratch);
+      int cmp = compare_titles(title.data, title.length, s, len);
+      if (cmp == 0) {
+        return mid;
+      }
+      if (cmp < 0) {
+        low = mid + 1;
+      } else {
+        high = mid;
+      }
+    }
+    return UINT32_MAX;
+  }
+
+  // Find the last bucket whose head is <= s, heads decode without any prefix
+  uint32_t bucket_count =
+      (view->length + view->bucket_size - 1) / view->bucket_size;
+  uint32_t low = 0;
+  uint32_t high = bucket_count;
+  while (low < high) {
+    uint32_t mid = low + (high - low) / 2;
+    struct Str head = decode_bucket(view, mid, 0, scratch);
+    if (compare_titles(head.data, head.length, s, len) <= 0) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  if (low == 0) {
+    return UINT32_MAX;
+  }
+  uint32_t bucket = low - 1;
+  uint32_t first = bucket * view->bucket_size;
+  uint32_t count = view->length - first < view->bucket_size
+                       ? view->length - first
+                       : view->bucket_size;
+  struct BucketCursor bucket_cursor = bucket_cursor_init(view, bucket, scratch);
+  for (uint32_t i = 0; i < count; i++) {
+    if (i > 0) {
+      bucket_cursor_next(&bucket_cursor);
+    }
+    int cmp = compare_titles(scratch, bucket_cursor.length, s, len);
+    if (cmp == 0) {
+      return first + i;
+    }
+    if (cmp > 0) {
+      break;
+    }
+  }
+  return UINT32_MAX;
 }
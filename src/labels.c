@@ -0,0 +1,506 @@
+#include "header.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+
+// Pruned landmark labeling (Akiba et al. 2013) for directed graphs. Every node
+// gets an out label, (hub, distance) pairs it can reach, and an in label,
+// pairs that can reach it. The labels form a 2-hop cover, so
+//
+//   dist(s, t) = min over hubs h of out[s][h] + in[t][h]
+//
+// Hubs are processed in degree order and stored by their rank in that order,
+// so every label is sorted by hub and a query is one merge of two lists.
+//
+// Label file layout: a LabelHeader followed by sections, see section_file.c
+//
+//   OUT_OFFSETS  uint64[node_count + 1], offsets into OUT_HUBS / OUT_DISTS
+//   OUT_HUBS     uint32[out_entries], hub ranks sorted per node
+//   OUT_DISTS    uint8[out_entries]
+//   IN_*         the same for in labels
+
+#define LABEL_UNREACHED 0xff
+
+struct LabelVec {
+  uint32_t* hubs;
+  uint8_t* dists;
+  uint32_t length;
+  uint32_t capacity;
+};
+
+static void label_vec_push(struct LabelVec* vec, uint32_t hub, uint8_t dist) {
+  if (vec->length == vec->capacity) {
+    vec->capacity = vec->capacity == 0 ? 4 : vec->capacity * 2;
+    vec->hubs = realloc(vec->hubs, vec->capacity * sizeof(uint32_t));
+    vec->dists = realloc(vec->dists, vec->capacity);
+  }
+  vec->hubs[vec->length] = hub;
+  vec->dists[vec->length] = dist;
+  vec->length++;
+}
+
+// Sense reversing barrier, yields while waiting so more workers than cores
+// still make progress
+struct SpinBarrier {
+  atomic_uint arrived;
+  atomic_uint generation;
+  uint32_t count;
+};
+
+static void spin_barrier_wait(struct SpinBarrier* barrier) {
+  if (barrier->count == 1) {
+    return;
+  }
+  uint32_t generation = atomic_load(&barrier->generation);
+  if (atomic_fetch_add(&barrier->arrived, 1) + 1 == barrier->count) {
+    atomic_store(&barrier->arrived, 0);
+    atomic_fetch_add(&barrier->generation, 1);
+    return;
+  }
+  while (atomic_load(&barrier->generation) == generation) {
+    sched_yield();
+  }
+}
+
+// Labels found by one search of a batch, applied once the whole batch is done
+struct PendingLabel {
+  uint32_t node;
+  uint8_t dist;
+};
+
+struct PendingVec {
+  struct PendingLabel* data;
+  uint32_t length;
+  uint32_t capacity;
+};
+
+static void pending_push(struct PendingVec* vec, uint32_t node, uint8_t dist) {
+  if (vec->length == vec->capacity) {
+    vec->capacity = vec->capacity == 0 ? 64 : vec->capacity * 2;
+    vec->data =
+        realloc(vec->data, vec->capacity * sizeof(struct PendingLabel));
+  }
+  vec->data[vec->length++] = (struct PendingLabel) {node, dist};
+}
+
+// One direction of the labeling. Forward searches run BFS over out edges from
+// a hub and write in labels, pruning with the hub's out label. Backward ones
+// are the mirror image.
+struct LabelDirection {
+  const uint32_t* offsets;
+  const uint32_t* targets;
+  struct LabelVec* written;
+  struct LabelVec* root_side;
+};
+
+// Hubs are searched in batches of batch_hubs, both directions each, spread
+// over the threads. A batch only reads the labels of earlier batches and its
+// results are applied in hub order once it is done. Pruning against fewer
+// hubs keeps a label that a serial build would have dropped, never drops one
+// it would have kept, so the labels are still a 2-hop cover; one hub per
+// batch is exactly the serial build.
+struct LabelBuild {
+  struct LabelDirection directions[2]; // forward, backward
+  const uint32_t* order;
+  uint32_t node_count;
+  uint32_t batch_hubs;
+  uint32_t thread_count;
+  struct PendingVec* pending; // per search of a batch, 2 * batch_hubs
+  struct SpinBarrier barrier;
+};
+
+struct LabelWorker {
+  struct LabelBuild* build;
+  uint32_t index;
+  uint8_t* root_dist; // by hub rank, from root_side of the current root
+  uint32_t* root_hubs;
+  uint8_t* dist;      // by node, of the current BFS
+  uint32_t* queue;
+};
+
+static void label_search(struct LabelWorker* worker,
+                         const struct LabelDirection* direction,
+                         uint32_t rank, struct PendingVec* found) {
+  uint32_t root = worker->build->order[rank];
+  struct LabelVec* root_side = &direction->root_side[root];
+  uint32_t root_hub_count = root_side->length;
+  for (uint32_t i = 0; i < root_hub_count; i++) {
+    worker->root_hubs[i] = root_side->hubs[i];
+    worker->root_dist[root_side->hubs[i]] = root_side->dists[i];
+  }
+
+  uint32_t head = 0;
+  uint32_t tail = 0;
+  worker->queue[tail++] = root;
+  worker->dist[root] = 0;
+  while (head < tail) {
+    uint32_t node = worker->queue[head++];
+    uint8_t dist = worker->dist[node];
+
+    // Prune when an earlier hub already covers this pair at least as well
+    struct LabelVec* label = &direction->written[node];
+    int covered = 0;
+    for (uint32_t i = 0; i < label->length; i++) {
+      uint8_t via = worker->root_dist[label->hubs[i]];
+      if (via != LABEL_UNREACHED && via + label->dists[i] <= dist) {
+        covered = 1;
+        break;
+      }
+    }
+    if (covered) {
+      continue;
+    }
+    pending_push(found, node, dist);
+
+    if (dist + 1 >= LABEL_UNREACHED) {
+      continue;
+    }
+    for (uint32_t i = direction->offsets[node];
+         i < direction->offsets[node + 1]; i++) {
+      uint32_t next = direction->targets[i];
+      if (worker->dist[next] == LABEL_UNREACHED) {
+        worker->dist[next] = dist + 1;
+        worker->queue[tail++] = next;
+      }
+    }
+  }
+
+  for (uint32_t i = 0; i < tail; i++) {
+    worker->dist[worker->queue[i]] = LABEL_UNREACHED;
+  }
+  for (uint32_t i = 0; i < root_hub_count; i++) {
+    worker->root_dist[worker->root_hubs[i]] = LABEL_UNREACHED;
+  }
+}
+
+static void* label_worker_run(void* arg) {
+  struct LabelWorker* worker = arg;
+  struct LabelBuild* build = worker->build;
+  for (uint32_t first = 0; first < build->node_count;
+       first += build->batch_hubs) {
+    uint32_t hubs = build->node_count - first < build->batch_hubs
+                        ? build->node_count - first
+                        : build->batch_hubs;
+    // Search i is the forward or backward search of hub first + i / 2
+    for (uint32_t i = worker->index; i < 2 * hubs; i += build->thread_count) {
+      label_search(worker, &build->directions[i & 1], first + i / 2,
+                   &build->pending[i]);
+    }
+    spin_barrier_wait(&build->barrier);
+
+    // One thread per direction, in hub order so labels stay sorted by hub
+    for (uint32_t d = worker->index; d < 2; d += build->thread_count) {
+      for (uint32_t i = d; i < 2 * hubs; i += 2) {
+        struct PendingVec* found = &build->pending[i];
+        for (uint32_t j = 0; j < found->length; j++) {
+          label_vec_push(&build->directions[d].written[found->data[j].node],
+                         first + i / 2, found->data[j].dist);
+        }
+        found->length = 0;
+      }
+    }
+    spin_barrier_wait(&build->barrier);
+  }
+  return NULL;
+}
+
+static struct LabelWorker label_worker_init(struct LabelBuild* build,
+                                            uint32_t index) {
+  uint32_t node_count = build->node_count;
+  struct LabelWorker worker = {
+      .build = build,
+      .index = index,
+      .root_dist = malloc(node_count + 1),
+      .root_hubs = malloc((node_count + 1) * sizeof(uint32_t)),
+      .dist = malloc(node_count + 1),
+      .queue = malloc((node_count + 1) * sizeof(uint32_t)),
+  };
+  memset(worker.root_dist, LABEL_UNREACHED, node_count + 1);
+  memset(worker.dist, LABEL_UNREACHED, node_count + 1);
+  return worker;
+}
+
+static void label_worker_destroy(struct LabelWorker* worker) {
+  free(worker->root_dist);
+  free(worker->root_hubs);
+  free(worker->dist);
+  free(worker->queue);
+}
+
+static const struct Graph* order_graph;
+
+// Highest total degree first, hubs on many shortest paths prune the most
+static int compare_degree(const void* a, const void* b) {
+  uint32_t x = *(const uint32_t*) a;
+  uint32_t y = *(const uint32_t*) b;
+  uint32_t x_degree = order_graph->out_offsets[x + 1] -
+                      order_graph->out_offsets[x] +
+                      order_graph->in_offsets[x + 1] - order_graph->in_offsets[x];
+  uint32_t y_degree = order_graph->out_offsets[y + 1] -
+                      order_graph->out_offsets[y] +
+                      order_graph->in_offsets[y + 1] - order_graph->in_offsets[y];
+  if (x_degree != y_degree) {
+    return x_degree > y_degree ? -1 : 1;
+  }
+  return (x > y) - (x < y);
+}
+
+// Flattens per node labels into offsets / hubs / dists arrays and frees them
+static uint64_t flatten_labels(struct LabelVec* labels, uint32_t node_count,
+                               uint64_t** offsets, uint32_t** hubs,
+                               uint8_t** dists) {
+  uint64_t total = 0;
+  for (uint32_t i = 0; i < node_count; i++) {
+    total += labels[i].length;
+  }
+  *offsets = malloc((node_count + 1) * sizeof(uint64_t));
+  *hubs = malloc((total + 1) * sizeof(uint32_t));
+  *dists = malloc(total + 1);
+  uint64_t cursor = 0;
+  for (uint32_t i = 0; i < node_count; i++) {
+    (*offsets)[i] = cursor;
+    memcpy(*hubs + cursor, labels[i].hubs, labels[i].length * sizeof(uint32_t));
+    memcpy(*dists + cursor, labels[i].dists, labels[i].length);
+    cursor += labels[i].length;
+    free(labels[i].hubs);
+    free(labels[i].dists);
+  }
+  (*offsets)[node_count] = cursor;
+  free(labels);
+  return total;
+}
+
+int label_index_build(const struct Graph* graph, const char* path,
+                      uint32_t threads) {
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  uint32_t node_count = graph->node_count;
+
+  uint32_t* order = malloc((node_count + 1) * sizeof(uint32_t));
+  for (uint32_t i = 0; i < node_count; i++) {
+    order[i] = i;
+  }
+  order_graph = graph;
+  qsort(order, node_count, sizeof(uint32_t), compare_degree);
+  order_graph = NULL;
+
+  struct LabelVec* out = calloc(node_count + 1, sizeof(struct LabelVec));
+  struct LabelVec* in = calloc(node_count + 1, sizeof(struct LabelVec));
+  if (threads == 0) {
+    threads = 1;
+  }
+  struct LabelBuild build = {
+      .directions =
+          {
+              {graph->out_offsets, graph->out_targets, in, out},
+              {graph->in_offsets, graph->in_targets, out, in},
+          },
+      .order = order,
+      .node_count = node_count,
+      .batch_hubs = (threads + 1) / 2,
+      .thread_count = threads,
+      .barrier = {.count = threads},
+  };
+  build.pending = calloc(2 * build.batch_hubs, sizeof(struct PendingVec));
+
+  struct LabelWorker* workers = malloc(threads * sizeof(struct LabelWorker));
+  pthread_t* handles = malloc(threads * sizeof(pthread_t));
+  for (uint32_t i = 0; i < threads; i++) {
+    workers[i] = label_worker_init(&build, i);
+  }
+  for (uint32_t i = 1; i < threads; i++) {
+    pthread_create(&handles[i], NULL, label_worker_run, &workers[i]);
+  }
+  label_worker_run(&workers[0]);
+  for (uint32_t i = 0; i < threads; i++) {
+    if (i > 0) {
+      pthread_join(handles[i], NULL);
+    }
+    label_worker_destroy(&workers[i]);
+  }
+  for (uint32_t i = 0; i < 2 * build.batch_hubs; i++) {
+    free(build.pending[i].data);
+  }
+  free(build.pending);
+  free(workers);
+  free(handles);
+
+  struct LabelHeader header = {
+      .magic = LABEL_MAGIC,
+      .version = LABEL_VERSION,
+      .node_count = node_count,
+      .edge_count = graph->edge_count,
+  };
+  uint64_t *out_offsets, *in_offsets;
+  uint32_t *out_hubs, *in_hubs;
+  uint8_t *out_dists, *in_dists;
+  header.out_entries =
+      flatten_labels(out, node_count, &out_offsets, &out_hubs, &out_dists);
+  header.in_entries =
+      flatten_labels(in, node_count, &in_offsets, &in_hubs, &in_dists);
+
+  const void* section_data[LABEL_SECTION_COUNT] = {
+      [LABEL_SECTION_OUT_OFFSETS] = out_offsets,
+      [LABEL_SECTION_OUT_HUBS] = out_hubs,
+      [LABEL_SECTION_OUT_DISTS] = out_dists,
+      [LABEL_SECTION_IN_OFFSETS] = in_offsets,
+      [LABEL_SECTION_IN_HUBS] = in_hubs,
+      [LABEL_SECTION_IN_DISTS] = in_dists,
+  };
+  header.sections[LABEL_SECTION_OUT_OFFSETS].length =
+      (node_count + 1) * sizeof(uint64_t);
+  header.sections[LABEL_SECTION_OUT_HUBS].length =
+      header.out_entries * sizeof(uint32_t);
+  header.sections[LABEL_SECTION_OUT_DISTS].length = header.out_entries;
+  header.sections[LABEL_SECTION_IN_OFFSETS].length =
+      (node_count + 1) * sizeof(uint64_t);
+  header.sections[LABEL_SECTION_IN_HUBS].length =
+      header.in_entries * sizeof(uint32_t);
+  header.sections[LABEL_SECTION_IN_DISTS].length = header.in_entries;
+
+  int result = section_file_write(path, &header, sizeof(header),
+                                  header.sections, section_data,
+                                  LABEL_SECTION_COUNT);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  if (result == 0) {
+    uint64_t bytes = 0;
+    for (int i = 0; i < LABEL_SECTION_COUNT; i++) {
+      bytes += header.sections[i].length;
+    }
+    log_info("Labeled %u nodes in %.2f s on %u threads: %lu out + %lu in "
+             "entries, %.1f per node, %.1f MB\n",
+             node_count,
+             (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9,
+             threads, (unsigned long) header.out_entries,
+             (unsigned long) header.in_entries,
+             (double) (header.out_entries + header.in_entries) /
+                 (node_count > 0 ? node_count : 1),
+             bytes / 1e6);
+  }
+
+  free(order);
+  free(out_offsets);
+  free(out_hubs);
+  free(out_dists);
+  free(in_offsets);
+  free(in_hubs);
+  free(in_dists);
+  return result;
+}
+
+int label_index_open(struct LabelIndex* index, const char* path,
+                     const struct Graph* graph) {
+  memset(index, 0, sizeof(*index));
+  size_t length;
+  void* map = section_file_map(path, sizeof(struct LabelHeader), &length, 0);
+  if (map == NULL) {
+    return 1;
+  }
+  const struct LabelHeader* header = map;
+  if (header->magic != LABEL_MAGIC || header->version != LABEL_VERSION) {
+    log_error("%s is not a label file of version %u\n", path, LABEL_VERSION);
+    munmap(map, length);
+    return 1;
+  }
+  if (header->node_count != graph->node_count ||
+      header->edge_count != graph->edge_count) {
+    log_error("%s was built for a different graph\n", path);
+    munmap(map, length);
+    return 1;
+  }
+  if (section_file_check(path, header->sections, LABEL_SECTION_COUNT,
+                         length) != 0) {
+    munmap(map, length);
+    return 1;
+  }
+
+  const char* base = map;
+  index->map = map;
+  index->map_length = length;
+  index->header = header;
+  index->out_offsets =
+      (const uint64_t*) (base + header->sections[LABEL_SECTION_OUT_OFFSETS].offset);
+  index->out_hubs =
+      (const uint32_t*) (base + header->sections[LABEL_SECTION_OUT_HUBS].offset);
+  index->out_dists =
+      (const uint8_t*) (base + header->sections[LABEL_SECTION_OUT_DISTS].offset);
+  index->in_offsets =
+      (const uint64_t*) (base + header->sections[LABEL_SECTION_IN_OFFSETS].offset);
+  index->in_hubs =
+      (const uint32_t*) (base + header->sections[LABEL_SECTION_IN_HUBS].offset);
+  index->in_dists =
+      (const uint8_t*) (base + header->sections[LABEL_SECTION_IN_DISTS].offset);
+  return 0;
+}
+
+void label_index_close(struct LabelIndex* index) {
+  if (index->map != NULL) {
+    munmap(index->map, index->map_length);
+  }
+  memset(index, 0, sizeof(*index));
+}
+
+uint32_t label_distance(const struct LabelIndex* index, uint32_t source,
+                        uint32_t target) {
+  uint64_t i = index->out_offsets[source];
+  uint64_t i_end = index->out_offsets[source + 1];
+  uint64_t j = index->in_offsets[target];
+  uint64_t j_end = index->in_offsets[target + 1];
+  uint32_t best = UINT32_MAX;
+  while (i < i_end && j < j_end) {
+    uint32_t out_hub = index->out_hubs[i];
+    uint32_t in_hub = index->in_hubs[j];
+    if (out_hub == in_hub) {
+      uint32_t dist = index->out_dists[i] + index->in_dists[j];
+      if (dist < best) {
+        best = dist;
+      }
+      i++;
+      j++;
+    } else if (out_hub < in_hub) {
+      i++;
+    } else {
+      j++;
+    }
+  }
+  return best;
+}
+
+// Walks from source, at each step taking any neighbour one hop closer to the
+// target according to the labels, so no search is needed
+uint32_t label_shortest_path(const struct Graph* graph,
+                             const struct LabelIndex* index, uint32_t source,
+                             uint32_t target, uint32_t* path) {
+  uint32_t remaining = label_distance(index, source, target);
+  if (remaining == UINT32_MAX || remaining >= SEARCH_MAX_PATH) {
+    return 0;
+  }
+  uint32_t length = 0;
+  uint32_t node = source;
+  path[length++] = node;
+  while (node != target) {
+    uint32_t next = UINT32_MAX;
+    for (uint32_t i = graph->out_offsets[node];
+         i < graph->out_offsets[node + 1]; i++) {
+      uint32_t candidate = graph->out_targets[i];
+      if (candidate == target ||
+          label_distance(index, candidate, target) == remaining - 1) {
+        next = candidate;
+        break;
+      }
+    }
+    if (next == UINT32_MAX) {
+      log_error("Labels don't match the graph at node %u\n", node);
+      return 0;
+    }
+    node = next;
+    path[length++] = node;
+    remaining--;
+  }
+  return length;
+}
@@ -0,0 +1,276 @@
+#include "header.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Multi-source BFS (Then et al. 2015). Every source gets one bit lane in a
+// row of `words` uint64 per node, so one pass over the edges advances all of
+// the sources by a level.
+//
+// Levels are pulled rather than pushed: a node ORs together the frontier
+// lanes of the nodes linking to it. Each thread owns a range of nodes and is
+// the only one writing their rows, so a level needs no atomics, only a
+// barrier before the frontiers are swapped.
+
+struct MsBfsShared;
+
+struct MsBfsWorker {
+  struct MsBfs* msbfs;
+  struct MsBfsShared* shared;
+  uint32_t begin;
+  uint32_t end;
+  uint64_t new_pairs; // this level
+  uint32_t eccentricity[MSBFS_MAX_SOURCES];
+  uint32_t reached[MSBFS_MAX_SOURCES];
+  uint64_t distance_sum[MSBFS_MAX_SOURCES];
+  uint32_t farthest[MSBFS_MAX_SOURCES];
+};
+
+struct MsBfsShared {
+  pthread_barrier_t barrier;
+  struct MsBfsWorker* workers;
+  uint64_t histogram[SEARCH_MAX_PATH];
+  uint32_t depth;
+  int done;
+};
+
+struct MsBfs msbfs_init(const struct Graph* graph, uint32_t max_sources,
+                        uint32_t threads, int reverse) {
+  // Rows are 1, 2, 4 or 8 words so each fits one vector type
+  uint32_t words = 1;
+  while (words < MSBFS_MAX_WORDS && words * 64 < max_sources) {
+    words *= 2;
+  }
+  size_t row_bytes = (size_t) words * sizeof(uint64_t);
+  size_t bytes = ((size_t) graph->node_count + 1) * row_bytes;
+  return (struct MsBfs) {
+      .graph = graph,
+      .words = words,
+      .threads = threads == 0 ? 1 : threads,
+      .reverse = reverse,
+      .seen = aligned_alloc(64, (bytes + 63) & ~(size_t) 63),
+      .visit = aligned_alloc(64, (bytes + 63) & ~(size_t) 63),
+      .next = aligned_alloc(64, (bytes + 63) & ~(size_t) 63),
+  };
+}
+
+void msbfs_destroy(struct MsBfs* msbfs) {
+  free(msbfs->seen);
+  free(msbfs->visit);
+  free(msbfs->next);
+  memset(msbfs, 0, sizeof(*msbfs));
+}
+
+// Credits every lane set in row to its source at this depth
+static void record_lanes(struct MsBfsWorker* worker, const uint64_t* row,
+                         uint32_t words, uint32_t node, uint32_t depth) {
+  for (uint32_t w = 0; w < words; w++) {
+    uint64_t bits = row[w];
+    worker->new_pairs += __builtin_popcountll(bits);
+    while (bits != 0) {
+      uint32_t source = w * 64 + __builtin_ctzll(bits);
+      bits &= bits - 1;
+      worker->reached[source]++;
+      worker->distance_sum[source] += depth;
+      worker->eccentricity[source] = depth;
+      worker->farthest[source] = node;
+    }
+  }
+}
+
+// Rows of lanes as GCC vector types, lowered to SSE2, AVX2 or AVX-512
+// operations depending on the target
+typedef uint64_t Lanes64;
+typedef uint64_t Lanes128 __attribute__((vector_size(16)));
+typedef uint64_t Lanes256 __attribute__((vector_size(32)));
+typedef uint64_t Lanes512 __attribute__((vector_size(64)));
+
+static inline int lanes_any(const void* row, uint32_t words) {
+  const uint64_t* lanes = row;
+  uint64_t any = 0;
+  for (uint32_t w = 0; w < words; w++) {
+    any |= lanes[w];
+  }
+  return any != 0;
+}
+
+// One level over the worker's nodes. Pulling along in edges gives distances
+// from the sources, out edges distances to them.
+#define DEFINE_PULL_LEVEL(name, Lanes)                                         \
+  static void name(struct MsBfsWorker* worker, uint32_t depth) {               \
+    struct MsBfs* msbfs = worker->msbfs;                                       \
+    const struct Graph* graph = msbfs->graph;                                  \
+    const uint32_t* offsets =                                                  \
+        msbfs->reverse ? graph->out_offsets : graph->in_offsets;               \
+    const uint32_t* targets =                                                  \
+        msbfs->reverse ? graph->out_targets : graph->in_targets;               \
+    const Lanes* visit = (const Lanes*) msbfs->visit;                          \
+    Lanes* seen = (Lanes*) msbfs->seen;                                        \
+    Lanes* next = (Lanes*) msbfs->next;                                        \
+    const uint32_t words = sizeof(Lanes) / sizeof(uint64_t);                   \
+    const Lanes zero = {0};                                                    \
+                                                                               \
+    for (uint32_t node = worker->begin; node < worker->end; node++) {          \
+      Lanes was_seen = seen[node];                                             \
+      Lanes unseen = ~was_seen;                                                \
+      /* Every source has reached this node already */                         \
+      if (!lanes_any(&unseen, words)) {                                        \
+        next[node] = zero;                                                     \
+        continue;                                                              \
+      }                                                                        \
+      Lanes reached = zero;                                                    \
+      for (uint32_t i = offsets[node]; i < offsets[node + 1]; i++) {           \
+        reached |= visit[targets[i]];                                          \
+      }                                                                        \
+      reached &= unseen;                                                       \
+      next[node] = reached;                                                    \
+      seen[node] = was_seen | reached;                                         \
+      if (lanes_any(&reached, words)) {                                        \
+        record_lanes(worker, (const uint64_t*) &next[node], words, node,       \
+                     depth);                                                   \
+      }                                                                        \
+    }                                                                          \
+  }
+
+DEFINE_PULL_LEVEL(pull_level_64, Lanes64)
+DEFINE_PULL_LEVEL(pull_level_128, Lanes128)
+DEFINE_PULL_LEVEL(pull_level_256, Lanes256)
+DEFINE_PULL_LEVEL(pull_level_512, Lanes512)
+
+static void pull_level(struct MsBfsWorker* worker, uint32_t depth) {
+  switch (worker->msbfs->words) {
+  case 1:
+    pull_level_64(worker, depth);
+    break;
+  case 2:
+    pull_level_128(worker, depth);
+    break;
+  case 4:
+    pull_level_256(worker, depth);
+    break;
+  default:
+    pull_level_512(worker, depth);
+  }
+}
+
+static void* msbfs_worker_run(void* arg) {
+  struct MsBfsWorker* worker = arg;
+  struct MsBfs* msbfs = worker->msbfs;
+  struct MsBfsShared* shared = worker->shared;
+
+  for (uint32_t depth = 1; depth < SEARCH_MAX_PATH; depth++) {
+    worker->new_pairs = 0;
+    pull_level(worker, depth);
+    pthread_barrier_wait(&shared->barrier);
+    // The first worker totals the level and swaps the frontiers while the
+    // others wait
+    if (worker == shared->workers) {
+      uint64_t new_pairs = 0;
+      for (uint32_t i = 0; i < msbfs->threads; i++) {
+        new_pairs += shared->workers[i].new_pairs;
+      }
+      shared->histogram[depth] = new_pairs;
+      shared->done = new_pairs == 0;
+      if (new_pairs > 0) {
+        shared->depth = depth;
+      }
+      uint64_t* visit = msbfs->visit;
+      msbfs->visit = msbfs->next;
+      msbfs->next = visit;
+    }
+    pthread_barrier_wait(&shared->barrier);
+    if (shared->done) {
+      break;
+    }
+  }
+  return NULL;
+}
+
+int msbfs_run(struct MsBfs* msbfs, const uint32_t* sources,
+              uint32_t source_count, struct MsBfsResult* result) {
+  const struct Graph* graph = msbfs->graph;
+  uint32_t words = msbfs->words;
+  if (source_count > words * 64) {
+    log_error("%u sources don't fit in %u lanes\n", source_count, words * 64);
+    return 1;
+  }
+  size_t bytes = ((size_t) graph->node_count + 1) * words * sizeof(uint64_t);
+  // Lanes without a source start out seen, so a node every source has
+  // reached can be skipped without masking
+  uint64_t unused[MSBFS_MAX_WORDS];
+  for (uint32_t w = 0; w < words; w++) {
+    uint32_t used = source_count > w * 64 ? source_count - w * 64 : 0;
+    unused[w] = used >= 64 ? 0 : ~0ULL << used;
+  }
+  for (uint32_t node = 0; node <= graph->node_count; node++) {
+    memcpy(&msbfs->seen[(size_t) node * words], unused,
+           words * sizeof(uint64_t));
+  }
+  memset(msbfs->visit, 0, bytes);
+  memset(result, 0, sizeof(*result));
+  result->source_count = source_count;
+  for (uint32_t i = 0; i < source_count; i++) {
+    uint64_t bit = 1ULL << (i & 63);
+    msbfs->seen[(size_t) sources[i] * words + i / 64] |= bit;
+    msbfs->visit[(size_t) sources[i] * words + i / 64] |= bit;
+    result->reached[i] = 1;
+    result->farthest[i] = sources[i];
+  }
+
+  uint32_t thread_count = msbfs->threads;
+  struct MsBfsShared shared = {
+      .workers = calloc(thread_count, sizeof(struct MsBfsWorker)),
+  };
+  pthread_barrier_init(&shared.barrier, NULL, thread_count);
+  // Split by edges rather than nodes, that is where the work is
+  const uint32_t* offsets =
+      msbfs->reverse ? graph->out_offsets : graph->in_offsets;
+  uint32_t begin = 0;
+  for (uint32_t t = 0; t < thread_count; t++) {
+    uint64_t edge_goal =
+        (uint64_t) graph->edge_count * (t + 1) / thread_count;
+    uint32_t end = begin;
+    while (end < graph->node_count &&
+           (t + 1 == thread_count || offsets[end] < edge_goal)) {
+      end++;
+    }
+    shared.workers[t] = (struct MsBfsWorker) {
+        .msbfs = msbfs,
+        .shared = &shared,
+        .begin = begin,
+        .end = end,
+    };
+    begin = end;
+  }
+  pthread_t* handles = malloc(thread_count * sizeof(pthread_t));
+  for (uint32_t t = 1; t < thread_count; t++) {
+    pthread_create(&handles[t], NULL, msbfs_worker_run, &shared.workers[t]);
+  }
+  msbfs_worker_run(&shared.workers[0]);
+  for (uint32_t t = 1; t < thread_count; t++) {
+    pthread_join(handles[t], NULL);
+  }
+
+  result->histogram[0] = source_count;
+  for (uint32_t d = 1; d < SEARCH_MAX_PATH; d++) {
+    result->histogram[d] = shared.histogram[d];
+  }
+  result->depth = shared.depth;
+  for (uint32_t t = 0; t < thread_count; t++) {
+    struct MsBfsWorker* worker = &shared.workers[t];
+    for (uint32_t i = 0; i < source_count; i++) {
+      result->reached[i] += worker->reached[i];
+      result->distance_sum[i] += worker->distance_sum[i];
+      if (worker->eccentricity[i] > result->eccentricity[i]) {
+        result->eccentricity[i] = worker->eccentricity[i];
+        result->farthest[i] = worker->farthest[i];
+      }
+    }
+  }
+
+  pthread_barrier_destroy(&shared.barrier);
+  free(shared.workers);
+  free(handles);
+  return 0;
+}
@@ -0,0 +1,246 @@
+#include "header.h"
+#include <fnmatch.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+// Mask file layout: a MaskHeader followed by sections, see section_file.c
+//
+//   NAMES  char[mask_count][MASK_NAME_MAX], NUL padded
+//   BITS   uint64[mask_count][words], bit i of a mask is node i
+//
+// Masks are worked out once from the titles and category links of a graph,
+// queries then only combine whole words of them.
+
+#define CATEGORY_PREFIX "Category:"
+
+int node_mask_spec_parse(struct NodeMaskSpec* spec, const char* arg) {
+  const char* equals = strchr(arg, '=');
+  if (equals == NULL || equals == arg || equals - arg >= MASK_NAME_MAX) {
+    log_error("Expected name=title:GLOB or name=category:GLOB, got %s\n", arg);
+    return 1;
+  }
+  memset(spec, 0, sizeof(*spec));
+  memcpy(spec->name, arg, equals - arg);
+  if (strcspn(spec->name, "|&! ") != strlen(spec->name)) {
+    log_error("Mask names can't contain |, &, ! or spaces: %s\n", spec->name);
+    return 1;
+  }
+  const char* rule = equals + 1;
+  if (strncmp(rule, "title:", 6) == 0) {
+    spec->kind = NODE_MASK_TITLE;
+    spec->pattern = rule + 6;
+  } else if (strncmp(rule, "category:", 9) == 0) {
+    spec->kind = NODE_MASK_CATEGORY;
+    spec->pattern = rule + 9;
+  } else {
+    log_error("Unknown mask rule %s, expected title: or category:\n", rule);
+    return 1;
+  }
+  return 0;
+}
+
+// The usual banned groups of game variants
+static const char* default_specs[] = {
+    "lists=title:List of *",
+    "years=title:[0-9]*",
+    "disambiguation=title:*(disambiguation)",
+    "living=category:Living people",
+};
+#define DEFAULT_SPEC_COUNT (sizeof(default_specs) / sizeof(default_specs[0]))
+
+uint32_t node_mask_default_specs(struct NodeMaskSpec* specs) {
+  for (uint32_t i = 0; i < DEFAULT_SPEC_COUNT; i++) {
+    node_mask_spec_parse(&specs[i], default_specs[i]);
+  }
+  return DEFAULT_SPEC_COUNT;
+}
+
+static void bit_set(uint64_t* bits, uint32_t i) {
+  bits[i >> 6] |= 1ULL << (i & 63);
+}
+
+// One pass over the titles fills every mask
+static void fill_masks(const struct Graph* graph,
+                       const struct NodeMaskSpec* specs, uint32_t count,
+                       uint32_t words, uint64_t* bits) {
+  char scratch[TITLE_MAX_LENGTH];
+  size_t prefix_length = strlen(CATEGORY_PREFIX);
+  for (uint32_t node = 0; node < graph->node_count; node++) {
+    struct Str title = interner_view_get(&graph->titles, node, scratch);
+    int is_category = title.length > prefix_length &&
+                      memcmp(title.data, CATEGORY_PREFIX, prefix_length) == 0;
+    for (uint32_t m = 0; m < count; m++) {
+      uint64_t* mask = &bits[(size_t) m * words];
+      if (specs[m].kind == NODE_MASK_TITLE) {
+        if (fnmatch(specs[m].pattern, title.data, 0) == 0) {
+          bit_set(mask, node);
+        }
+        continue;
+      }
+      // Pages are in a category when they link to its page
+      if (!is_category ||
+          fnmatch(specs[m].pattern, title.data + prefix_length, 0) != 0) {
+        continue;
+      }
+      for (uint32_t i = graph->in_offsets[node];
+           i < graph->in_offsets[node + 1]; i++) {
+        bit_set(mask, graph->in_targets[i]);
+      }
+    }
+  }
+}
+
+int node_masks_build(const struct Graph* graph, const char* path,
+                     const struct NodeMaskSpec* specs, uint32_t count) {
+  if (count == 0 || count > MASK_MAX_COUNT) {
+    log_error("Mask count must be between 1 and %u\n", MASK_MAX_COUNT);
+    return 1;
+  }
+  uint32_t words = graph->node_count / 64 + 1;
+  char(*names)[MASK_NAME_MAX] = calloc(count, MASK_NAME_MAX);
+  uint64_t* bits = calloc((size_t) count * words, sizeof(uint64_t));
+  for (uint32_t m = 0; m < count; m++) {
+    memcpy(names[m], specs[m].name, MASK_NAME_MAX);
+  }
+  fill_masks(graph, specs, count, words, bits);
+
+  struct MaskHeader header = {
+      .magic = MASK_MAGIC,
+      .version = MASK_VERSION,
+      .node_count = graph->node_count,
+      .edge_count = graph->edge_count,
+      .mask_count = count,
+      .words = words,
+  };
+  header.sections[MASK_SECTION_NAMES].length = (uint64_t) count * MASK_NAME_MAX;
+  header.sections[MASK_SECTION_BITS].length =
+      (uint64_t) count * words * sizeof(uint64_t);
+  const void* data[MASK_SECTION_COUNT] = {
+      [MASK_SECTION_NAMES] = names,
+      [MASK_SECTION_BITS] = bits,
+  };
+  int result = section_file_write(path, &header, sizeof(header),
+                                  header.sections, data, MASK_SECTION_COUNT);
+  for (uint32_t m = 0; m < count && result == 0; m++) {
+    uint64_t nodes = 0;
+    for (uint32_t w = 0; w < words; w++) {
+      nodes += __builtin_popcountll(bits[(size_t) m * words + w]);
+    }
+    log_info("Mask %s: %lu nodes\n", specs[m].name, nodes);
+  }
+  free(names);
+  free(bits);
+  return result;
+}
+
+int node_masks_open(struct NodeMasks* masks, const char* path,
+                    const struct Graph* graph) {
+  memset(masks, 0, sizeof(*masks));
+  size_t length;
+  void* map = section_file_map(path, sizeof(struct MaskHeader), &length, 0);
+  if (map == NULL) {
+    return 1;
+  }
+  const struct MaskHeader* header = map;
+  if (header->magic != MASK_MAGIC || header->version != MASK_VERSION) {
+    log_error("%s is not a mask file of version %u\n", path, MASK_VERSION);
+    munmap(map, length);
+    return 1;
+  }
+  if (header->node_count != graph->node_count ||
+      header->edge_count != graph->edge_count) {
+    log_error("%s was built for a different graph\n", path);
+    munmap(map, length);
+    return 1;
+  }
+  if (section_file_check(path, header->sections, MASK_SECTION_COUNT,
+                         length) != 0) {
+    munmap(map, length);
+    return 1;
+  }
+
+  const char* base = map;
+  const struct GraphSection* sections = header->sections;
+  masks->map = map;
+  masks->map_length = length;
+  masks->header = header;
+  masks->count = header->mask_count;
+  masks->words = header->words;
+  masks->names = (const char(*)[MASK_NAME_MAX])(
+      base + sections[MASK_SECTION_NAMES].offset);
+  masks->bits = (const uint64_t*) (base + sections[MASK_SECTION_BITS].offset);
+  return 0;
+}
+
+void node_masks_close(struct NodeMasks* masks) {
+  if (masks->map != NULL) {
+    munmap(masks->map, masks->map_length);
+  }
+  memset(masks, 0, sizeof(*masks));
+}
+
+const uint64_t* node_masks_find(const struct NodeMasks* masks,
+                                const char* name, size_t length) {
+  if (length >= MASK_NAME_MAX) {
+    return NULL;
+  }
+  for (uint32_t m = 0; m < masks->count; m++) {
+    if (strncmp(masks->names[m], name, length) == 0 &&
+        masks->names[m][length] == '\0') {
+      return &masks->bits[(size_t) m * masks->words];
+    }
+  }
+  return NULL;
+}
+
+// Expressions are ORs of ANDs of optionally negated names, & binding tighter
+// than |, e.g. "lists|dates|!living&people"
+int node_masks_compile(const struct NodeMasks* masks, const char* expression,
+                       uint64_t* out) {
+  uint32_t words = masks->words;
+  uint64_t* term = malloc(words * sizeof(uint64_t));
+  memset(out, 0, words * sizeof(uint64_t));
+  int term_started = 0;
+  const char* cursor = expression;
+  for (;;) {
+    cursor += strspn(cursor, " ");
+    int negate = *cursor == '!';
+    cursor += negate;
+    size_t length = strcspn(cursor, "|&");
+    size_t trimmed = length;
+    while (trimmed > 0 && cursor[trimmed - 1] == ' ') {
+      trimmed--;
+    }
+    const uint64_t* mask = node_masks_find(masks, cursor, trimmed);
+    if (mask == NULL) {
+      log_error("Unknown mask %.*s in %s\n", (int) trimmed, cursor,
+                expression);
+      free(term);
+      return 1;
+    }
+    uint64_t flip = negate ? ~0ULL : 0;
+    for (uint32_t w = 0; w < words; w++) {
+      term[w] = term_started ? term[w] & (mask[w] ^ flip) : mask[w] ^ flip;
+    }
+    term_started = 1;
+
+    cursor += length;
+    if (*cursor != '&') {
+      for (uint32_t w = 0; w < words; w++) {
+        out[w] |= term[w];
+      }
+      term_started = 0;
+    }
+    if (*cursor == '\0') {
+      break;
+    }
+    cursor++;
+  }
+  // Negations set the bits past the last node as well
+  uint32_t tail = masks->header->node_count & 63;
+  out[words - 1] &= tail == 0 ? 0 : ~0ULL >> (64 - tail);
+  free(term);
+  return 0;
+}
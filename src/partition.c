@@ -0,0 +1,233 @@
+#include "header.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+// Shard file layout: a ShardHeader followed by sections, see section_file.c
+//
+//   NODES        uint32[local_node_count], global ids of the owned nodes
+//   OUT_OFFSETS  uint32[local_node_count + 1], CSR offsets into OUT_TARGETS
+//   OUT_TARGETS  uint32[local_edge_count], global ids
+//   OWNERS       uint16[node_count], shard of every node in the graph
+//   LOCAL_IDS    uint32[node_count], index of every node in its shard
+
+// Slack over a perfectly even split the greedy partitioner may use
+#define GREEDY_SLACK 1.05
+
+static void partition_range(const struct Graph* graph, uint32_t shard_count,
+                            uint16_t* owners) {
+  // Weigh nodes by their edges as well, the BFS work is in the edges
+  uint64_t total = (uint64_t) graph->node_count + graph->edge_count;
+  uint64_t seen = 0;
+  uint32_t shard = 0;
+  for (uint32_t node = 0; node < graph->node_count; node++) {
+    while (shard + 1 < shard_count &&
+           seen >= total * (shard + 1) / shard_count) {
+      shard++;
+    }
+    owners[node] = shard;
+    seen += 1 + graph->out_offsets[node + 1] - graph->out_offsets[node];
+  }
+}
+
+static void count_placed(const uint32_t* offsets, const uint32_t* targets,
+                         uint32_t node, const uint16_t* owners,
+                         uint32_t* counts) {
+  for (uint32_t i = offsets[node]; i < offsets[node + 1]; i++) {
+    uint16_t owner = owners[targets[i]];
+    if (owner != UINT16_MAX) {
+      counts[owner]++;
+    }
+  }
+}
+
+// Stanton and Kliot 2012, streams the nodes in id order once
+static void partition_greedy(const struct Graph* graph, uint32_t shard_count,
+                             uint16_t* owners) {
+  uint32_t* sizes = calloc(shard_count, sizeof(uint32_t));
+  uint32_t* counts = calloc(shard_count, sizeof(uint32_t));
+  double capacity =
+      (double) graph->node_count / shard_count * GREEDY_SLACK + 1;
+  for (uint32_t node = 0; node < graph->node_count; node++) {
+    owners[node] = UINT16_MAX;
+  }
+
+  for (uint32_t node = 0; node < graph->node_count; node++) {
+    memset(counts, 0, shard_count * sizeof(uint32_t));
+    count_placed(graph->out_offsets, graph->out_targets, node, owners, counts);
+    count_placed(graph->in_offsets, graph->in_targets, node, owners, counts);
+
+    uint32_t best = UINT32_MAX;
+    double best_score = -1;
+    for (uint32_t i = 0; i < shard_count; i++) {
+      if (sizes[i] >= capacity) {
+        continue;
+      }
+      double score = counts[i] * (1 - sizes[i] / capacity);
+      // Ties, including nodes with no placed neighbours, go to the smallest
+      if (score > best_score ||
+          (score == best_score && sizes[i] < sizes[best])) {
+        best = i;
+        best_score = score;
+      }
+    }
+    owners[node] = best;
+    sizes[best]++;
+  }
+  free(sizes);
+  free(counts);
+}
+
+static int write_shard(const struct Graph* graph, const char* prefix,
+                       uint32_t shard_count, enum PartitionKind kind,
+                       uint32_t index, const uint16_t* owners,
+                       const uint32_t* local_ids, uint32_t local_node_count) {
+  uint32_t* nodes = malloc((local_node_count + 1) * sizeof(uint32_t));
+  uint32_t* offsets = malloc((local_node_count + 1) * sizeof(uint32_t));
+  uint32_t local = 0;
+  uint32_t edge_count = 0;
+  offsets[0] = 0;
+  for (uint32_t node = 0; node < graph->node_count; node++) {
+    if (owners[node] == index) {
+      nodes[local++] = node;
+      edge_count += graph->out_offsets[node + 1] - graph->out_offsets[node];
+      offsets[local] = edge_count;
+    }
+  }
+  uint32_t* targets = malloc((edge_count + 1) * sizeof(uint32_t));
+  for (uint32_t i = 0; i < local_node_count; i++) {
+    uint32_t node = nodes[i];
+    memcpy(&targets[offsets[i]], &graph->out_targets[graph->out_offsets[node]],
+           (offsets[i + 1] - offsets[i]) * sizeof(uint32_t));
+  }
+
+  struct ShardHeader header = {
+      .magic = SHARD_MAGIC,
+      .version = SHARD_VERSION,
+      .partition = kind,
+      .shard_index = index,
+      .shard_count = shard_count,
+      .node_count = graph->node_count,
+      .local_node_count = local_node_count,
+      .local_edge_count = edge_count,
+  };
+  header.sections[SHARD_SECTION_NODES].length =
+      (uint64_t) local_node_count * sizeof(uint32_t);
+  header.sections[SHARD_SECTION_OUT_OFFSETS].length =
+      ((uint64_t) local_node_count + 1) * sizeof(uint32_t);
+  header.sections[SHARD_SECTION_OUT_TARGETS].length =
+      (uint64_t) edge_count * sizeof(uint32_t);
+  header.sections[SHARD_SECTION_OWNERS].length =
+      (uint64_t) graph->node_count * sizeof(uint16_t);
+  header.sections[SHARD_SECTION_LOCAL_IDS].length =
+      (uint64_t) graph->node_count * sizeof(uint32_t);
+  const void* data[SHARD_SECTION_COUNT] = {
+      [SHARD_SECTION_NODES] = nodes,
+      [SHARD_SECTION_OUT_OFFSETS] = offsets,
+      [SHARD_SECTION_OUT_TARGETS] = targets,
+      [SHARD_SECTION_OWNERS] = owners,
+      [SHARD_SECTION_LOCAL_IDS] = local_ids,
+  };
+
+  char path[1024];
+  snprintf(path, sizeof(path), "%s.%u", prefix, index);
+  int result = section_file_write(path, &header, sizeof(header),
+                                  header.sections, data, SHARD_SECTION_COUNT);
+  if (result == 0) {
+    log_info("Wrote %s with %u nodes and %u edges\n", path, local_node_count,
+             edge_count);
+  }
+  free(nodes);
+  free(offsets);
+  free(targets);
+  return result;
+}
+
+int partition_graph(const struct Graph* graph, const char* prefix,
+                    uint32_t shard_count, enum PartitionKind kind) {
+  if (shard_count == 0 || shard_count > SHARD_MAX_COUNT) {
+    log_error("Shard count must be between 1 and %u\n", SHARD_MAX_COUNT);
+    return 1;
+  }
+  uint16_t* owners = malloc((graph->node_count + 1) * sizeof(uint16_t));
+  if (kind == PARTITION_GREEDY) {
+    partition_greedy(graph, shard_count, owners);
+  } else {
+    partition_range(graph, shard_count, owners);
+  }
+
+  uint32_t* local_ids = malloc((graph->node_count + 1) * sizeof(uint32_t));
+  uint32_t* local_counts = calloc(shard_count, sizeof(uint32_t));
+  uint64_t cut_edges = 0;
+  for (uint32_t node = 0; node < graph->node_count; node++) {
+    local_ids[node] = local_counts[owners[node]]++;
+    for (uint32_t i = graph->out_offsets[node];
+         i < graph->out_offsets[node + 1]; i++) {
+      cut_edges += owners[graph->out_targets[i]] != owners[node];
+    }
+  }
+  log_info("%lu of %u edges cross shards\n", cut_edges, graph->edge_count);
+
+  int result = 0;
+  for (uint32_t i = 0; i < shard_count && result == 0; i++) {
+    result = write_shard(graph, prefix, shard_count, kind, i, owners,
+                         local_ids, local_counts[i]);
+  }
+  free(owners);
+  free(local_ids);
+  free(local_counts);
+  return result;
+}
+
+static const void* shard_section(const struct Shard* shard,
+                                 enum ShardSectionId id) {
+  return (const char*) shard->map + shard->header->sections[id].offset;
+}
+
+int shard_open(struct Shard* shard, const char* prefix, uint32_t index) {
+  memset(shard, 0, sizeof(*shard));
+  char path[1024];
+  snprintf(path, sizeof(path), "%s.%u", prefix, index);
+  size_t length;
+  void* map = section_file_map(path, sizeof(struct ShardHeader), &length, 0);
+  if (map == NULL) {
+    return 1;
+  }
+
+  const struct ShardHeader* header = map;
+  if (header->magic != SHARD_MAGIC || header->version != SHARD_VERSION ||
+      header->shard_index != index) {
+    log_error("%s is not shard %u of version %u\n", path, index,
+              SHARD_VERSION);
+    munmap(map, length);
+    return 1;
+  }
+  if (section_file_check(path, header->sections, SHARD_SECTION_COUNT,
+                         length) != 0) {
+    munmap(map, length);
+    return 1;
+  }
+
+  shard->map = map;
+  shard->map_length = length;
+  shard->header = header;
+  shard->index = index;
+  shard->count = header->shard_count;
+  shard->node_count = header->node_count;
+  shard->local_node_count = header->local_node_count;
+  shard->nodes = shard_section(shard, SHARD_SECTION_NODES);
+  shard->out_offsets = shard_section(shard, SHARD_SECTION_OUT_OFFSETS);
+  shard->out_targets = shard_section(shard, SHARD_SECTION_OUT_TARGETS);
+  shard->owners = shard_section(shard, SHARD_SECTION_OWNERS);
+  shard->local_ids = shard_section(shard, SHARD_SECTION_LOCAL_IDS);
+  return 0;
+}
+
+void shard_close(struct Shard* shard) {
+  if (shard->map != NULL) {
+    munmap(shard->map, shard->map_length);
+  }
+  memset(shard, 0, sizeof(*shard));
+}
@@ -0,0 +1,394 @@
+#include "header.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Two levels of caching in front of the search, sized for skewed traffic
+// where a few targets take most of the queries.
+//
+// Trees: once a target has been asked for tree_admit_after times it is queued,
+// and query_cache_build_trees later runs a BFS over the in edges from it that
+// records every node's distance to it and the next node on a shortest path.
+// Any query to that target is then a walk of next pointers. Building is kept
+// out of lookups since one BFS over the whole graph costs many queries. When
+// the budget is full a new tree replaces the one whose target has been asked
+// for least, if that is less than the new target.
+//
+// Pairs: an LRU map from (source, target) to the path, for the queries that
+// repeat but whose target isn't hot enough to have a tree. The bucket array
+// counts against the same budget as the entries.
+
+#define TREE_UNREACHED 0xff
+#define NO_TREE UINT32_MAX
+#define PENDING_TREE (UINT32_MAX - 1) // queued for query_cache_build_trees
+#define MAX_PENDING_TREES 64
+
+struct TargetTree {
+  uint32_t target;
+  uint8_t* dist;
+  uint32_t* next; // the node after this one on a shortest path to target
+};
+
+struct PairEntry {
+  struct PairEntry* hash_next;
+  struct PairEntry* newer;
+  struct PairEntry* older;
+  uint64_t key;
+  uint32_t length;
+  uint32_t path[];
+};
+
+struct QueryCache {
+  const struct Graph* graph;
+  uint32_t graph_node_count; // still known once graph is unmapped
+  struct QueryCacheOptions options;
+  struct QueryCacheStats stats;
+  uint32_t* target_counts;
+  uint32_t* tree_index; // per node, NO_TREE unless it is a cached target
+  struct TargetTree* trees;
+  uint32_t tree_count;
+  uint32_t tree_capacity;
+  uint32_t pending[MAX_PENDING_TREES];
+  uint32_t pending_count;
+  uint32_t* queue;
+  struct PairEntry** buckets;
+  uint64_t bucket_mask;
+  struct PairEntry* newest;
+  struct PairEntry* oldest;
+};
+
+struct QueryCacheOptions query_cache_default_options() {
+  return (struct QueryCacheOptions) {
+      .tree_budget_bytes = 1UL << 30,
+      .tree_admit_after = 4,
+      .pair_budget_bytes = 64UL << 20,
+  };
+}
+
+static size_t tree_size(const struct Graph* graph) {
+  return (size_t) graph->node_count * (sizeof(uint8_t) + sizeof(uint32_t));
+}
+
+static size_t bucket_bytes(const struct QueryCache* cache) {
+  return (cache->bucket_mask + 1) * sizeof(struct PairEntry*);
+}
+
+static int has_tree(const struct QueryCache* cache, uint32_t target) {
+  return cache->tree_index[target] < PENDING_TREE;
+}
+
+struct QueryCache* query_cache_init(const struct Graph* graph,
+                                    const struct QueryCacheOptions* options) {
+  struct QueryCache* cache = calloc(1, sizeof(struct QueryCache));
+  cache->graph = graph;
+  cache->graph_node_count = graph->node_count;
+  cache->options = *options;
+  cache->target_counts = calloc(graph->node_count + 1, sizeof(uint32_t));
+  cache->tree_index = malloc((graph->node_count + 1) * sizeof(uint32_t));
+  for (uint32_t i = 0; i < graph->node_count; i++) {
+    cache->tree_index[i] = NO_TREE;
+  }
+  cache->tree_capacity = options->tree_budget_bytes / tree_size(graph);
+  cache->trees = calloc(cache->tree_capacity + 1, sizeof(struct TargetTree));
+  cache->queue = malloc((graph->node_count + 1) * sizeof(uint32_t));
+
+  // About one bucket per short path's worth of budget
+  uint64_t buckets = 16;
+  while (buckets * 128 < options->pair_budget_bytes) {
+    buckets *= 2;
+  }
+  cache->buckets = calloc(buckets, sizeof(struct PairEntry*));
+  cache->bucket_mask = buckets - 1;
+  cache->stats.pair_bytes = bucket_bytes(cache);
+  return cache;
+}
+
+void query_cache_destroy(struct QueryCache* cache) {
+  for (uint32_t i = 0; i < cache->tree_count; i++) {
+    free(cache->trees[i].dist);
+    free(cache->trees[i].next);
+  }
+  struct PairEntry* entry = cache->newest;
+  while (entry != NULL) {
+    struct PairEntry* older = entry->older;
+    free(entry);
+    entry = older;
+  }
+  free(cache->target_counts);
+  free(cache->tree_index);
+  free(cache->trees);
+  free(cache->queue);
+  free(cache->buckets);
+  free(cache);
+}
+
+// ====== Trees ===== //
+
+static void tree_build(struct QueryCache* cache, struct TargetTree* tree,
+                       uint32_t target) {
+  const struct Graph* graph = cache->graph;
+  memset(tree->dist, TREE_UNREACHED, graph->node_count);
+  tree->target = target;
+  tree->dist[target] = 0;
+  tree->next[target] = target;
+
+  uint32_t head = 0;
+  uint32_t tail = 0;
+  cache->queue[tail++] = target;
+  while (head < tail) {
+    uint32_t node = cache->queue[head++];
+    uint8_t dist = tree->dist[node] + 1;
+    // Paths longer than SEARCH_MAX_PATH nodes aren't answered by the search
+    // either
+    if (dist >= SEARCH_MAX_PATH - 1) {
+      break;
+    }
+    for (uint32_t i = graph->in_offsets[node]; i < graph->in_offsets[node + 1];
+         i++) {
+      uint32_t prev = graph->in_targets[i];
+      if (tree->dist[prev] == TREE_UNREACHED) {
+        tree->dist[prev] = dist;
+        tree->next[prev] = node;
+        cache->queue[tail++] = prev;
+      }
+    }
+  }
+  cache->tree_index[target] = tree - cache->trees;
+  cache->stats.trees_built++;
+}
+
+// Finds room for a tree of target, returns NULL when every cached target is
+// at least as hot
+static struct TargetTree* tree_admit(struct QueryCache* cache,
+                                     uint32_t target) {
+  if (cache->tree_count < cache->tree_capacity) {
+    struct TargetTree* tree = &cache->trees[cache->tree_count++];
+    tree->dist = malloc(cache->graph->node_count + 1);
+    tree->next = malloc((cache->graph->node_count + 1) * sizeof(uint32_t));
+    cache->stats.tree_bytes += tree_size(cache->graph);
+    return tree;
+  }
+  struct TargetTree* coldest = NULL;
+  for (uint32_t i = 0; i < cache->tree_count; i++) {
+    struct TargetTree* tree = &cache->trees[i];
+    if (coldest == NULL || cache->target_counts[tree->target] <
+                               cache->target_counts[coldest->target]) {
+      coldest = tree;
+    }
+  }
+  if (coldest == NULL ||
+      cache->target_counts[coldest->target] >= cache->target_counts[target]) {
+    return NULL;
+  }
+  cache->tree_index[coldest->target] = NO_TREE;
+  cache->stats.tree_evictions++;
+  return coldest;
+}
+
+uint32_t query_cache_build_trees(struct QueryCache* cache) {
+  uint32_t built = 0;
+  for (uint32_t i = 0; i < cache->pending_count; i++) {
+    uint32_t target = cache->pending[i];
+    cache->tree_index[target] = NO_TREE;
+    struct TargetTree* tree = tree_admit(cache, target);
+    if (tree != NULL) {
+      tree_build(cache, tree, target);
+      built++;
+    }
+  }
+  cache->pending_count = 0;
+  return built;
+}
+
+static uint32_t tree_walk(const struct TargetTree* tree, uint32_t source,
+                          uint32_t* path) {
+  if (tree->dist[source] == TREE_UNREACHED) {
+    return 0;
+  }
+  uint32_t length = 0;
+  for (uint32_t node = source; node != tree->target; node = tree->next[node]) {
+    path[length++] = node;
+  }
+  path[length++] = tree->target;
+  return length;
+}
+
+// ====== Pairs ===== //
+
+static uint64_t pair_key(uint32_t source, uint32_t target) {
+  return (uint64_t) source << 32 | target;
+}
+
+// splitmix64 finalizer, the keys themselves are far from uniform
+static uint64_t pair_hash(uint64_t key) {
+  key ^= key >> 30;
+  key *= 0xbf58476d1ce4e5b9ULL;
+  key ^= key >> 27;
+  key *= 0x94d049bb133111ebULL;
+  return key ^ (key >> 31);
+}
+
+static size_t pair_size(const struct PairEntry* entry) {
+  return sizeof(struct PairEntry) + entry->length * sizeof(uint32_t);
+}
+
+static struct PairEntry** pair_slot(struct QueryCache* cache, uint64_t key) {
+  struct PairEntry** slot =
+      &cache->buckets[pair_hash(key) & cache->bucket_mask];
+  while (*slot != NULL && (*slot)->key != key) {
+    slot = &(*slot)->hash_next;
+  }
+  return slot;
+}
+
+static void pair_unlink(struct QueryCache* cache, struct PairEntry* entry) {
+  if (entry->newer != NULL) {
+    entry->newer->older = entry->older;
+  } else {
+    cache->newest = entry->older;
+  }
+  if (entry->older != NULL) {
+    entry->older->newer = entry->newer;
+  } else {
+    cache->oldest = entry->newer;
+  }
+}
+
+static void pair_push_newest(struct QueryCache* cache,
+                             struct PairEntry* entry) {
+  entry->newer = NULL;
+  entry->older = cache->newest;
+  if (cache->newest != NULL) {
+    cache->newest->newer = entry;
+  } else {
+    cache->oldest = entry;
+  }
+  cache->newest = entry;
+}
+
+static void pair_evict_oldest(struct QueryCache* cache) {
+  struct PairEntry* entry = cache->oldest;
+  pair_unlink(cache, entry);
+  struct PairEntry** slot = pair_slot(cache, entry->key);
+  *slot = entry->hash_next;
+  cache->stats.pair_bytes -= pair_size(entry);
+  cache->stats.pair_evictions++;
+  free(entry);
+}
+
+// ====== Lookups ===== //
+
+uint32_t query_cache_lookup(struct QueryCache* cache, uint32_t source,
+                            uint32_t target, uint32_t* path) {
+  cache->stats.lookups++;
+  if (cache->target_counts[target] < UINT32_MAX) {
+    cache->target_counts[target]++;
+  }
+
+  if (has_tree(cache, target)) {
+    cache->stats.tree_hits++;
+    return tree_walk(&cache->trees[cache->tree_index[target]], source, path);
+  }
+  // A full queue drops the target, it is queued again on its next lookup
+  if (cache->tree_index[target] == NO_TREE &&
+      cache->target_counts[target] >= cache->options.tree_admit_after &&
+      cache->pending_count < MAX_PENDING_TREES) {
+    cache->tree_index[target] = PENDING_TREE;
+    cache->pending[cache->pending_count++] = target;
+  }
+
+  struct PairEntry* entry = *pair_slot(cache, pair_key(source, target));
+  if (entry == NULL) {
+    return QUERY_CACHE_MISS;
+  }
+  pair_unlink(cache, entry);
+  pair_push_newest(cache, entry);
+  cache->stats.pair_hits++;
+  memcpy(path, entry->path, entry->length * sizeof(uint32_t));
+  return entry->length;
+}
+
+void query_cache_insert(struct QueryCache* cache, uint32_t source,
+                        uint32_t target, const uint32_t* path,
+                        uint32_t length) {
+  uint64_t key = pair_key(source, target);
+  size_t size = sizeof(struct PairEntry) + length * sizeof(uint32_t);
+  if (has_tree(cache, target) ||
+      size + bucket_bytes(cache) > cache->options.pair_budget_bytes ||
+      *pair_slot(cache, key) != NULL) {
+    return;
+  }
+  while (cache->stats.pair_bytes + size > cache->options.pair_budget_bytes) {
+    pair_evict_oldest(cache);
+  }
+
+  struct PairEntry* entry = malloc(size);
+  entry->key = key;
+  entry->length = length;
+  memcpy(entry->path, path, length * sizeof(uint32_t));
+  struct PairEntry** slot =
+      &cache->buckets[pair_hash(key) & cache->bucket_mask];
+  entry->hash_next = *slot;
+  *slot = entry;
+  pair_push_newest(cache, entry);
+  cache->stats.pair_bytes += size;
+}
+
+struct QueryCacheStats query_cache_stats(const struct QueryCache* cache) {
+  return cache->stats;
+}
+
+// ====== Generations ===== //
+
+static int has_edge(const struct Graph* graph, uint32_t from, uint32_t to) {
+  // Targets are sorted per node
+  uint32_t low = graph->out_offsets[from];
+  uint32_t high = graph->out_offsets[from + 1];
+  while (low < high) {
+    uint32_t mid = low + (high - low) / 2;
+    if (graph->out_targets[mid] < to) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low < graph->out_offsets[from + 1] && graph->out_targets[low] == to;
+}
+
+struct QueryCache* query_cache_translate(struct QueryCache* cache,
+                                         const struct Graph* graph,
+                                         const uint32_t* ids) {
+  struct QueryCache* next = query_cache_init(graph, &cache->options);
+  next->stats = cache->stats;
+  next->stats.tree_bytes = 0;
+  next->stats.pair_bytes = bucket_bytes(next);
+  for (uint32_t i = 0; i < cache->graph_node_count; i++) {
+    if (ids[i] != UINT32_MAX) {
+      next->target_counts[ids[i]] = cache->target_counts[i];
+    }
+  }
+
+  // Oldest first, so the LRU order survives
+  uint32_t path[SEARCH_MAX_PATH];
+  uint32_t kept = 0;
+  uint32_t total = 0;
+  for (struct PairEntry* entry = cache->oldest; entry != NULL;
+       entry = entry->newer) {
+    total++;
+    // Unreachable pairs may have become reachable
+    int valid = entry->length > 0;
+    for (uint32_t i = 0; i < entry->length && valid; i++) {
+      path[i] = ids[entry->path[i]];
+      valid = path[i] != UINT32_MAX &&
+              (i == 0 || has_edge(graph, path[i - 1], path[i]));
+    }
+    if (valid) {
+      query_cache_insert(next, path[0], path[entry->length - 1], path,
+                         entry->length);
+      kept++;
+    }
+  }
+  log_info("Kept %u of %u cached paths\n", kept, total);
+  query_cache_destroy(cache);
+  return next;
+}
@@ -0,0 +1,118 @@
+#include "header.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SCC_UNVISITED UINT32_MAX
+
+struct TarjanFrame {
+  uint32_t node;
+  uint32_t edge;
+};
+
+// Iterative Tarjan over a CSR graph, the wiki graph is far too deep for the
+// recursive version. Components are numbered in the order they complete, which
+// is a reverse topological order of the condensation: every edge between two
+// components goes from a higher id to a lower one.
+uint32_t scc_tarjan(uint32_t node_count, const uint32_t* offsets,
+                    const uint32_t* targets, uint32_t* component) {
+  uint32_t* index = malloc((node_count + 1) * sizeof(uint32_t));
+  uint32_t* lowlink = malloc((node_count + 1) * sizeof(uint32_t));
+  uint32_t* stack = malloc((node_count + 1) * sizeof(uint32_t));
+  struct TarjanFrame* frames =
+      malloc((node_count + 1) * sizeof(struct TarjanFrame));
+  for (uint32_t i = 0; i < node_count; i++) {
+    index[i] = SCC_UNVISITED;
+    component[i] = SCC_UNVISITED;
+  }
+
+  uint32_t next_index = 0;
+  uint32_t component_count = 0;
+  uint32_t stack_length = 0;
+  for (uint32_t root = 0; root < node_count; root++) {
+    if (index[root] != SCC_UNVISITED) {
+      continue;
+    }
+    uint32_t frame_count = 0;
+    index[root] = lowlink[root] = next_index++;
+    stack[stack_length++] = root;
+    frames[frame_count++] = (struct TarjanFrame) {root, offsets[root]};
+
+    while (frame_count > 0) {
+      struct TarjanFrame* frame = &frames[frame_count - 1];
+      uint32_t node = frame->node;
+      if (frame->edge < offsets[node + 1]) {
+        uint32_t next = targets[frame->edge++];
+        if (index[next] == SCC_UNVISITED) {
+          index[next] = lowlink[next] = next_index++;
+          stack[stack_length++] = next;
+          frames[frame_count++] = (struct TarjanFrame) {next, offsets[next]};
+        } else if (component[next] == SCC_UNVISITED) {
+          // Visited without a component means it is still on the stack
+          if (index[next] < lowlink[node]) {
+            lowlink[node] = index[next];
+          }
+        }
+        continue;
+      }
+
+      frame_count--;
+      if (lowlink[node] == index[node]) {
+        uint32_t member;
+        do {
+          member = stack[--stack_length];
+          component[member] = component_count;
+        } while (member != node);
+        component_count++;
+      }
+      if (frame_count > 0) {
+        uint32_t parent = frames[frame_count - 1].node;
+        if (lowlink[node] < lowlink[parent]) {
+          lowlink[parent] = lowlink[node];
+        }
+      }
+    }
+  }
+
+  free(index);
+  free(lowlink);
+  free(stack);
+  free(frames);
+  return component_count;
+}
+
+// Collects the edges between components, build_csr turns them into the
+// condensation DAG
+struct VecEdge scc_cross_edges(uint32_t node_count, const uint32_t* offsets,
+                               const uint32_t* targets,
+                               const uint32_t* component) {
+  struct VecEdge edges = vec_edge_init(1 << 16);
+  for (uint32_t node = 0; node < node_count; node++) {
+    for (uint32_t i = offsets[node]; i < offsets[node + 1]; i++) {
+      uint32_t from = component[node];
+      uint32_t to = component[targets[i]];
+      if (from != to) {
+        vec_edge_push(&edges, (struct Edge) {from, to});
+      }
+    }
+  }
+  return edges;
+}
+
+enum Reachability graph_reachability(const struct Graph* graph,
+                                     uint32_t source, uint32_t target) {
+  uint32_t source_component = graph->scc_ids[source];
+  uint32_t target_component = graph->scc_ids[target];
+  if (source_component == target_component) {
+    return REACHABILITY_YES;
+  }
+  // Edges only ever lead to lower component ids
+  if (source_component < target_component) {
+    return REACHABILITY_NO;
+  }
+  if (graph->scc_flags[source_component] & SCC_FLAG_SINK ||
+      graph->scc_flags[target_component] & SCC_FLAG_SOURCE) {
+    return REACHABILITY_NO;
+  }
+  return REACHABILITY_UNKNOWN;
+}
@@ -0,0 +1,184 @@
+#include "header.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+static inline int bit_test(const uint64_t* bits, uint32_t i) {
+  return (bits[i >> 6] >> (i & 63)) & 1;
+}
+
+static inline void bit_set(uint64_t* bits, uint32_t i) {
+  bits[i >> 6] |= 1ULL << (i & 63);
+}
+
+// Visited words and components prefetched per edge list, the first cache
+// line of targets
+#define PREFETCH_EDGES 16
+
+struct SearchState search_state_init(const struct Graph* graph) {
+  uint32_t words = graph->node_count / 64 + 1;
+  return (struct SearchState) {
+      .parent = malloc((graph->node_count + 1) * sizeof(uint32_t)),
+      .queue = malloc((graph->node_count + 1) * sizeof(uint32_t)),
+      .visited = calloc(words, sizeof(uint64_t)),
+      .constraints = search_constraints_none(),
+  };
+}
+
+struct SearchConstraints search_constraints_none() {
+  return (struct SearchConstraints) {
+      .banned = NULL,
+      .max_hops = SEARCH_MAX_PATH - 1,
+  };
+}
+
+void search_state_constrain(struct SearchState* state,
+                            const struct Graph* graph,
+                            const struct SearchConstraints* constraints) {
+  uint32_t words = graph->node_count / 64 + 1;
+  int was_banned = state->constraints.banned != NULL;
+  state->constraints = *constraints;
+  if (state->constraints.max_hops > SEARCH_MAX_PATH - 1) {
+    state->constraints.max_hops = SEARCH_MAX_PATH - 1;
+  }
+  // Banned nodes look visited, and searches put them back when clearing.
+  // Without a banned set searches leave visited all clear, so only dropping
+  // one has to clear it
+  if (constraints->banned != NULL) {
+    memcpy(state->visited, constraints->banned, words * sizeof(uint64_t));
+  } else if (was_banned) {
+    memset(state->visited, 0, words * sizeof(uint64_t));
+  }
+}
+
+void search_state_destroy(struct SearchState* state) {
+  free(state->parent);
+  free(state->queue);
+  free(state->visited);
+  memset(state, 0, sizeof(*state));
+}
+
+// Writes the path ending at target into path by walking parents, returns the
+// number of nodes in it
+static uint32_t walk_parents(struct SearchState* state, uint32_t source,
+                             uint32_t target, uint32_t* path) {
+  uint32_t length = 0;
+  for (uint32_t node = target; node != source; node = state->parent[node]) {
+    path[length++] = node;
+  }
+  path[length++] = source;
+  for (uint32_t i = 0; i < length / 2; i++) {
+    uint32_t tmp = path[i];
+    path[i] = path[length - 1 - i];
+    path[length - 1 - i] = tmp;
+  }
+  return length;
+}
+
+// Group prefetching over the queue. Expanding a node misses on its offsets,
+// its edge list and then the visited word and component of every target, each
+// load depending on the one before. Rather than wait on the chain for one node
+// at a time, the frontier is walked in three stages at different distances
+// ahead of the node being expanded, so by the time a node is reached all three
+// are in cache and the misses of a few nodes overlap.
+static inline void prefetch_frontier(const struct Graph* graph,
+                                     const struct SearchState* state,
+                                     uint32_t head, uint32_t tail,
+                                     uint32_t distance) {
+  const uint32_t* queue = state->queue;
+  if (head + 2 * distance < tail) {
+    __builtin_prefetch(&graph->out_offsets[queue[head + 2 * distance]]);
+  }
+  if (head + distance < tail) {
+    uint32_t node = queue[head + distance];
+    __builtin_prefetch(&graph->out_targets[graph->out_offsets[node]]);
+  }
+  if (head + distance / 2 < tail) {
+    uint32_t node = queue[head + distance / 2];
+    uint32_t begin = graph->out_offsets[node];
+    uint32_t end = graph->out_offsets[node + 1];
+    if (end - begin > PREFETCH_EDGES) {
+      end = begin + PREFETCH_EDGES;
+    }
+    for (uint32_t i = begin; i < end; i++) {
+      uint32_t next = graph->out_targets[i];
+      __builtin_prefetch(&state->visited[next >> 6]);
+      __builtin_prefetch(&graph->scc_ids[next]);
+    }
+  }
+}
+
+uint32_t search_shortest_path(const struct Graph* graph,
+                              struct SearchState* state, uint32_t source,
+                              uint32_t target, uint32_t* path) {
+  state->nodes_visited = 0;
+  const uint64_t* banned = state->constraints.banned;
+  if (banned != NULL &&
+      (bit_test(banned, source) || bit_test(banned, target))) {
+    return 0;
+  }
+  if (source == target) {
+    path[0] = source;
+    return 1;
+  }
+  if (state->constraints.max_hops == 0 ||
+      graph_reachability(graph, source, target) == REACHABILITY_NO) {
+    return 0;
+  }
+
+  // Only components numbered at or above the target's can still reach it
+  uint32_t target_component = graph->scc_ids[target];
+  uint32_t head = 0;
+  uint32_t tail = 0;
+  uint32_t level_end = 1;
+  uint32_t depth = 0;
+  uint32_t found = 0;
+  uint32_t distance = state->prefetch_distance;
+  state->queue[tail++] = source;
+  bit_set(state->visited, source);
+
+  while (head < tail && !found) {
+    if (head == level_end) {
+      level_end = tail;
+      if (++depth >= state->constraints.max_hops) {
+        break;
+      }
+    }
+    uint32_t node = state->queue[head++];
+    if (distance != 0) {
+      prefetch_frontier(graph, state, head, tail, distance);
+    }
+    uint32_t end = graph->out_offsets[node + 1];
+    for (uint32_t i = graph->out_offsets[node]; i < end; i++) {
+      // Hubs outrun the staged prefetches, so their edges prefetch ahead of
+      // themselves
+      if (distance != 0 && i + PREFETCH_EDGES < end) {
+        uint32_t ahead = graph->out_targets[i + PREFETCH_EDGES];
+        __builtin_prefetch(&state->visited[ahead >> 6]);
+        __builtin_prefetch(&graph->scc_ids[ahead]);
+      }
+      uint32_t next = graph->out_targets[i];
+      if (bit_test(state->visited, next) ||
+          graph->scc_ids[next] < target_component) {
+        continue;
+      }
+      bit_set(state->visited, next);
+      state->parent[next] = node;
+      state->queue[tail++] = next;
+      if (next == target) {
+        found = 1;
+        break;
+      }
+    }
+  }
+
+  uint32_t length = found ? walk_parents(state, source, target, path) : 0;
+  // Clearing only what was touched keeps short queries independent of the
+  // graph size
+  for (uint32_t i = 0; i < tail; i++) {
+    uint32_t word = state->queue[i] >> 6;
+    state->visited[word] = banned != NULL ? banned[word] : 0;
+  }
+  state->nodes_visited = tail;
+  return length;
+}
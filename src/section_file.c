@@ -0,0 +1,107 @@
+#include "header.h"
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Files written by the build (graph, labels) are a fixed header followed by
+// sections, each aligned to GRAPH_SECTION_ALIGN so they can be used in place
+// once mmap'd.
+
+static uint64_t align_up(uint64_t value, uint64_t align) {
+  return (value + align - 1) & ~(align - 1);
+}
+
+static int write_padding(FILE* file, uint64_t to) {
+  static const char zeros[GRAPH_SECTION_ALIGN] = {0};
+  long position = ftell(file);
+  if (position < 0 || (uint64_t) position > to) {
+    return 1;
+  }
+  return fwrite(zeros, 1, to - position, file) != to - position;
+}
+
+static int write_section(FILE* file, struct GraphSection section,
+                         const void* data) {
+  if (write_padding(file, section.offset) != 0) {
+    return 1;
+  }
+  return fwrite(data, 1, section.length, file) != section.length;
+}
+
+int section_file_write(const char* path, const void* header,
+                       size_t header_size, struct GraphSection* sections,
+                       const void* const* data, int count) {
+  uint64_t offset = header_size;
+  for (int i = 0; i < count; i++) {
+    offset = align_up(offset, GRAPH_SECTION_ALIGN);
+    sections[i].offset = offset;
+    offset += sections[i].length;
+  }
+
+  // Written next to path and renamed over it, so a solver watching path for
+  // a new generation never maps a half written file, and one still mapping
+  // the old file keeps its inode
+  char temp_path[4096];
+  snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+  FILE* file = fopen(temp_path, "wb");
+  if (file == NULL) {
+    log_error("Failed to open %s for writing\n", temp_path);
+    return 1;
+  }
+  int result = fwrite(header, header_size, 1, file) != 1;
+  for (int i = 0; i < count && result == 0; i++) {
+    result = write_section(file, sections[i], data[i]);
+  }
+  if (fclose(file) != 0) {
+    result = 1;
+  }
+  if (result == 0 && rename(temp_path, path) != 0) {
+    result = 1;
+  }
+  if (result != 0) {
+    log_error("Failed to write %s\n", path);
+    unlink(temp_path);
+  }
+  return result;
+}
+
+// Maps the file read only. The mapping is MAP_SHARED so every process that
+// opens the same file shares one copy of it in the page cache. map_flags are
+// added to the mmap flags, e.g. MAP_POPULATE.
+void* section_file_map(const char* path, size_t header_size, size_t* length,
+                       int map_flags) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    log_error("Failed to open %s\n", path);
+    return NULL;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t) st.st_size < header_size) {
+    log_error("%s is truncated\n", path);
+    close(fd);
+    return NULL;
+  }
+  void* map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED | map_flags, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    log_error("Failed to mmap %s\n", path);
+    return NULL;
+  }
+  *length = st.st_size;
+  return map;
+}
+
+int section_file_check(const char* path, const struct GraphSection* sections,
+                       int count, size_t length) {
+  for (int i = 0; i < count; i++) {
+    if (sections[i].offset + sections[i].length > length) {
+      log_error("%s section %d is out of bounds\n", path, i);
+      return 1;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,264 @@
+#include "header.h"
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// Generates MediaWiki export XML that looks enough like the real
+// pages-articles dump to exercise the parser: Zipf distributed link targets,
+// long tailed link counts, labelled links, red links, templates, sections and
+// non-article namespaces. The output only depends on the options, so the same
+// seed always produces byte identical dumps.
+
+static const char* syllables[] = {
+    "al", "an", "ar", "ber", "ca", "chi", "da", "del", "en", "er",  "fa",
+    "gor", "ha", "in", "is", "ka", "la", "lin", "ma", "mon", "na",  "nor",
+    "o",   "pa", "per", "ra", "ri", "sa", "son", "ta", "ter", "to", "u",
+    "va",  "ver", "win", "ya", "zen",
+};
+#define SYLLABLE_COUNT (sizeof(syllables) / sizeof(syllables[0]))
+
+static const char* disambiguations[] = {
+    " (disambiguation)", " (film)", " (album)", " (band)", " (novel)",
+    " (river)",          " (song)", " (surname)",
+};
+#define DISAMBIGUATION_COUNT (sizeof(disambiguations) / sizeof(disambiguations[0]))
+
+static const char* namespaces[] = {"Category:", "Template:", "File:",
+                                   "Wikipedia:", "Portal:"};
+#define NAMESPACE_COUNT (sizeof(namespaces) / sizeof(namespaces[0]))
+
+struct SynthRng {
+  uint64_t state;
+};
+
+// splitmix64, small and good enough for test data
+static uint64_t rng_next(struct SynthRng* rng) {
+  uint64_t z = (rng->state += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+static uint32_t rng_below(struct SynthRng* rng, uint32_t bound) {
+  return (uint32_t) (rng_next(rng) % bound);
+}
+
+// Uniform double in (0, 1]
+static double rng_unit(struct SynthRng* rng) {
+  return ((rng_next(rng) >> 11) + 1) * (1.0 / 9007199254740992.0);
+}
+
+// Approximate Zipf(s = 1) rank in [0, n), rank 0 is the most popular
+static uint32_t rng_zipf(struct SynthRng* rng, uint32_t n) {
+  uint32_t rank = (uint32_t) exp(rng_unit(rng) * log((double) n + 1)) - 1;
+  return rank < n ? rank : n - 1;
+}
+
+static void push_cstr(struct Arena* arena, const char* s) {
+  arena_push(arena, (void*) s, strlen(s));
+}
+
+static void push_word(struct Arena* arena, struct SynthRng* rng,
+                      int capitalise) {
+  uint32_t syllable_count = 1 + rng_below(rng, 3);
+  for (uint32_t i = 0; i < syllable_count; i++) {
+    const char* syllable = syllables[rng_below(rng, SYLLABLE_COUNT)];
+    if (i == 0 && capitalise) {
+      char upper = syllable[0] - 'a' + 'A';
+      arena_push(arena, &upper, 1);
+      push_cstr(arena, syllable + 1);
+    } else {
+      push_cstr(arena, syllable);
+    }
+  }
+}
+
+// Title words follow a geometric distribution, which gives the long tail of
+// title lengths seen in the real dump (median ~15 bytes, max a few hundred)
+static void push_title_words(struct Arena* arena, struct SynthRng* rng) {
+  push_word(arena, rng, 1);
+  while (rng_below(rng, 100) < 55) {
+    arena_push(arena, (void*) " ", 1);
+    push_word(arena, rng, rng_below(rng, 100) < 60);
+  }
+}
+
+static void push_title(struct Arena* arena, struct SynthRng* rng,
+                       const struct SynthDumpOptions* options) {
+  char number[32];
+  if (rng_below(rng, 100) < options->namespace_pct) {
+    const char* ns = namespaces[rng_below(rng, NAMESPACE_COUNT)];
+    push_cstr(arena, ns);
+    push_title_words(arena, rng);
+    if (strcmp(ns, "File:") == 0) {
+      push_cstr(arena, ".jpg");
+    }
+    return;
+  }
+
+  uint32_t kind = rng_below(rng, 100);
+  if (kind < 6) {
+    push_cstr(arena, "List of ");
+    push_title_words(arena, rng);
+  } else if (kind < 10) {
+    snprintf(number, sizeof(number), "%u in ", 1800 + rng_below(rng, 226));
+    push_cstr(arena, number);
+    push_title_words(arena, rng);
+  } else if (kind < 12) {
+    snprintf(number, sizeof(number), "%u", 1 + rng_below(rng, 2025));
+    push_cstr(arena, number);
+  } else if (kind < 18) {
+    push_title_words(arena, rng);
+    push_cstr(arena, disambiguations[rng_below(rng, DISAMBIGUATION_COUNT)]);
+  } else {
+    push_title_words(arena, rng);
+  }
+}
+
+static void push_filler(struct Arena* arena, struct SynthRng* rng,
+                        uint32_t words) {
+  for (uint32_t i = 0; i < words; i++) {
+    arena_push(arena, (void*) " ", 1);
+    push_word(arena, rng, 0);
+  }
+}
+
+static void push_link(struct Arena* body, struct SynthRng* rng,
+                      struct Arena* titles, struct VecSlice* title_slices,
+                      const struct SynthDumpOptions* options) {
+  push_cstr(body, " [[");
+  if (rng_below(rng, 100) < options->red_link_pct) {
+    push_title_words(body, rng);
+  } else {
+    uint32_t target = rng_zipf(rng, title_slices->length);
+    struct Slice slice = title_slices->data[target];
+    arena_push(body, arena_get_slice(titles, slice), slice.length);
+  }
+  if (rng_below(rng, 100) < 30) {
+    arena_push(body, (void*) "|", 1);
+    push_title_words(body, rng);
+  }
+  push_cstr(body, "]]");
+}
+
+static void push_template(struct Arena* body, struct SynthRng* rng) {
+  char number[32];
+  push_cstr(body, "{{Infobox");
+  push_filler(body, rng, 1);
+  uint32_t fields = 2 + rng_below(rng, 10);
+  for (uint32_t i = 0; i < fields; i++) {
+    push_cstr(body, "\n|");
+    push_filler(body, rng, 1);
+    push_cstr(body, " =");
+    push_filler(body, rng, 1 + rng_below(rng, 4));
+  }
+  push_cstr(body, "\n}}\n");
+  if (rng_below(rng, 2) == 0) {
+    snprintf(number, sizeof(number), "%u", rng_below(rng, 1000000));
+    push_cstr(body, "&lt;ref&gt;{{cite web |url=https://example.org/");
+    push_cstr(body, number);
+    push_cstr(body, " |title=");
+    push_filler(body, rng, 3);
+    push_cstr(body, "}}&lt;/ref&gt;");
+  }
+}
+
+static void build_body(struct Arena* body, struct SynthRng* rng,
+                       struct Arena* titles, struct VecSlice* title_slices,
+                       const struct SynthDumpOptions* options) {
+  body->length = 0;
+  if (rng_below(rng, 100) < options->template_pct) {
+    push_template(body, rng);
+  }
+
+  // Exponential link counts give a long tail of heavily linked pages
+  uint32_t links = (uint32_t) (-log(rng_unit(rng)) * options->mean_links);
+  for (uint32_t i = 0; i < links; i++) {
+    if (i % 8 == 7) {
+      push_cstr(body, "\n\n==");
+      push_filler(body, rng, 1 + rng_below(rng, 3));
+      push_cstr(body, " ==\n");
+    }
+    push_filler(body, rng, 3 + rng_below(rng, 20));
+    push_link(body, rng, titles, title_slices, options);
+  }
+  push_filler(body, rng, 5);
+
+  uint32_t categories = rng_below(rng, 4);
+  for (uint32_t i = 0; i < categories; i++) {
+    push_cstr(body, "\n[[Category:");
+    push_title_words(body, rng);
+    push_cstr(body, "]]");
+  }
+}
+
+struct SynthDumpOptions synth_dump_default_options() {
+  return (struct SynthDumpOptions) {
+      .page_count = 2000,
+      .mean_links = 25,
+      .red_link_pct = 10,
+      .template_pct = 40,
+      .namespace_pct = 10,
+      .seed = 1,
+  };
+}
+
+int synth_dump_write(FILE* out, const struct SynthDumpOptions* options) {
+  if (options->page_count == 0) {
+    log_error("synth_dump_write: page_count must be positive\n");
+    return 1;
+  }
+
+  struct SynthRng rng = {.state = options->seed};
+  struct Arena titles = arena_init(options->page_count * 32);
+  struct VecSlice title_slices = vec_slice_init(options->page_count);
+  for (uint32_t i = 0; i < options->page_count; i++) {
+    uint32_t offset = titles.length;
+    push_title(&titles, &rng, options);
+    struct Slice slice = {.offset = offset, .length = titles.length - offset};
+    vec_slice_push(&title_slices, slice);
+  }
+
+  fputs("<mediawiki xmlns=\"http://www.mediawiki.org/xml/export-0.11/\" "
+        "version=\"0.11\" xml:lang=\"en\">\n"
+        "  <siteinfo>\n"
+        "    <sitename>Wikipedia</sitename>\n"
+        "    <dbname>enwiki</dbname>\n"
+        "    <namespaces>\n"
+        "      <namespace key=\"0\" case=\"first-letter\" />\n"
+        "      <namespace key=\"6\" case=\"first-letter\">File</namespace>\n"
+        "      <namespace key=\"10\" case=\"first-letter\">Template</namespace>\n"
+        "      <namespace key=\"14\" case=\"first-letter\">Category</namespace>\n"
+        "    </namespaces>\n"
+        "  </siteinfo>\n",
+        out);
+
+  struct Arena body = arena_init(1 << 16);
+  for (uint32_t i = 0; i < options->page_count; i++) {
+    build_body(&body, &rng, &titles, &title_slices, options);
+    struct Slice title = title_slices.data[i];
+    fprintf(out,
+            "  <page>\n"
+            "    <title>%.*s</title>\n"
+            "    <ns>0</ns>\n"
+            "    <id>%u</id>\n"
+            "    <revision>\n"
+            "      <id>%u</id>\n"
+            "      <timestamp>2025-11-01T00:00:00Z</timestamp>\n"
+            "      <text bytes=\"%u\" xml:space=\"preserve\">",
+            (int) title.length, (char*) arena_get_slice(&titles, title), i + 1,
+            1000000 + i, body.length);
+    fwrite(body.data, 1, body.length, out);
+    fputs("</text>\n"
+          "    </revision>\n"
+          "  </page>\n",
+          out);
+  }
+  fputs("</mediawiki>\n", out);
+
+  free(body.data);
+  free(titles.data);
+  free(title_slices.data);
+  return ferror(out) ? 1 : 0;
+}
@@ -0,0 +1,372 @@
+#define _GNU_SOURCE // memfd_create
+#include "header.h"
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+// Message transports between the distributed search coordinator and the shard
+// servers. Each kind only provides a byte stream, the framing of ShardMessage
+// and its edges is shared.
+
+// ====== Unix socket ===== //
+
+struct SocketEnd {
+  int fd;
+};
+
+static int socket_write(void* impl, const void* data, size_t length) {
+  struct SocketEnd* end = impl;
+  const char* bytes = data;
+  while (length > 0) {
+    // MSG_NOSIGNAL so a dead peer is an error rather than SIGPIPE
+    ssize_t written = send(end->fd, bytes, length, MSG_NOSIGNAL);
+    if (written < 0 && errno == EINTR) {
+      continue;
+    }
+    if (written <= 0) {
+      return 1;
+    }
+    bytes += written;
+    length -= written;
+  }
+  return 0;
+}
+
+static int socket_read(void* impl, void* data, size_t length) {
+  struct SocketEnd* end = impl;
+  char* bytes = data;
+  while (length > 0) {
+    ssize_t got = read(end->fd, bytes, length);
+    if (got < 0 && errno == EINTR) {
+      continue;
+    }
+    if (got <= 0) {
+      return 1;
+    }
+    bytes += got;
+    length -= got;
+  }
+  return 0;
+}
+
+static void socket_close(void* impl) {
+  struct SocketEnd* end = impl;
+  close(end->fd);
+  free(end);
+}
+
+static const struct TransportOps socket_ops = {
+    .write = socket_write,
+    .read = socket_read,
+    .close = socket_close,
+};
+
+static int socket_pair(struct Transport* a, struct Transport* b) {
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+    log_error("Failed to create a socket pair\n");
+    return 1;
+  }
+  struct SocketEnd* a_end = malloc(sizeof(struct SocketEnd));
+  struct SocketEnd* b_end = malloc(sizeof(struct SocketEnd));
+  a_end->fd = fds[0];
+  b_end->fd = fds[1];
+  a->ops = b->ops = &socket_ops;
+  a->impl = a_end;
+  b->impl = b_end;
+  return 0;
+}
+
+// ====== Shared memory ===== //
+
+#define SHM_RING_SIZE (1 << 20)
+// How long a blocked end sleeps before checking that its peer is still alive
+#define SHM_POLL_NS 100000000L // 100ms
+
+// Single producer, single consumer byte ring. head and tail only grow, the
+// process shared mutex and condition variables block whichever side is ahead.
+// The mutex is robust, and waits time out to poll the peer, so a peer that
+// dies fails the ring instead of blocking the other end forever.
+struct ShmRing {
+  pthread_mutex_t lock;
+  pthread_cond_t readable;
+  pthread_cond_t writable;
+  uint64_t head; // read position
+  uint64_t tail; // write position
+  int broken;    // the peer died, possibly half way through a message
+  char data[SHM_RING_SIZE];
+};
+
+struct ShmChannel {
+  struct ShmRing rings[2];
+};
+
+// Each end maps the channel itself, so closing one end in a process leaves
+// the other end mapped
+struct ShmEnd {
+  struct ShmChannel* channel;
+  struct ShmRing* in;
+  struct ShmRing* out;
+  int peer; // pid of the process at the other end, 0 when not watched
+};
+
+// A parent is gone once we have been handed to another one. A child is gone
+// once it has exited, even before it is reaped. Anything else once it can't
+// be signalled
+static int process_alive(int pid) {
+  if (pid == getppid()) {
+    return 1;
+  }
+  siginfo_t info = {0};
+  if (waitid(P_PID, pid, &info, WEXITED | WNOHANG | WNOWAIT) == 0) {
+    return info.si_pid == 0;
+  }
+  return kill(pid, 0) == 0 || errno != ESRCH;
+}
+
+// Takes the ring lock, returns 1 without it when the ring is broken
+static int shm_lock(struct ShmRing* ring) {
+  if (pthread_mutex_lock(&ring->lock) == EOWNERDEAD) {
+    pthread_mutex_consistent(&ring->lock);
+    ring->broken = 1;
+  }
+  if (ring->broken) {
+    pthread_mutex_unlock(&ring->lock);
+    return 1;
+  }
+  return 0;
+}
+
+// Waits on cond with the ring lock held, returns 1 with the ring broken and
+// unlocked once the peer is gone
+static int shm_wait(struct ShmEnd* end, struct ShmRing* ring,
+                    pthread_cond_t* cond) {
+  struct timespec deadline;
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  deadline.tv_nsec += SHM_POLL_NS;
+  if (deadline.tv_nsec >= 1000000000L) {
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000000000L;
+  }
+  int result = pthread_cond_timedwait(cond, &ring->lock, &deadline);
+  if (result == EOWNERDEAD) {
+    pthread_mutex_consistent(&ring->lock);
+    ring->broken = 1;
+  } else if (result == ETIMEDOUT && end->peer != 0 &&
+             !process_alive(end->peer)) {
+    ring->broken = 1;
+  }
+  if (ring->broken) {
+    pthread_mutex_unlock(&ring->lock);
+    return 1;
+  }
+  return 0;
+}
+
+static int shm_write(void* impl, const void* data, size_t length) {
+  struct ShmEnd* end = impl;
+  struct ShmRing* ring = end->out;
+  const char* bytes = data;
+  if (shm_lock(ring) != 0) {
+    log_error("The reader of a shared memory transport died\n");
+    return 1;
+  }
+  while (length > 0) {
+    while (ring->tail - ring->head == SHM_RING_SIZE) {
+      if (shm_wait(end, ring, &ring->writable) != 0) {
+        log_error("The reader of a shared memory transport died\n");
+        return 1;
+      }
+    }
+    size_t position = ring->tail % SHM_RING_SIZE;
+    size_t space = SHM_RING_SIZE - (ring->tail - ring->head);
+    size_t chunk = SHM_RING_SIZE - position;
+    chunk = chunk < space ? chunk : space;
+    chunk = chunk < length ? chunk : length;
+    memcpy(&ring->data[position], bytes, chunk);
+    ring->tail += chunk;
+    bytes += chunk;
+    length -= chunk;
+    pthread_cond_signal(&ring->readable);
+  }
+  pthread_mutex_unlock(&ring->lock);
+  return 0;
+}
+
+static int shm_read(void* impl, void* data, size_t length) {
+  struct ShmEnd* end = impl;
+  struct ShmRing* ring = end->in;
+  char* bytes = data;
+  if (shm_lock(ring) != 0) {
+    log_error("The writer of a shared memory transport died\n");
+    return 1;
+  }
+  while (length > 0) {
+    while (ring->tail == ring->head) {
+      if (shm_wait(end, ring, &ring->readable) != 0) {
+        log_error("The writer of a shared memory transport died\n");
+        return 1;
+      }
+    }
+    size_t position = ring->head % SHM_RING_SIZE;
+    size_t chunk = SHM_RING_SIZE - position;
+    size_t available = ring->tail - ring->head;
+    chunk = chunk < available ? chunk : available;
+    chunk = chunk < length ? chunk : length;
+    memcpy(bytes, &ring->data[position], chunk);
+    ring->head += chunk;
+    bytes += chunk;
+    length -= chunk;
+    pthread_cond_signal(&ring->writable);
+  }
+  pthread_mutex_unlock(&ring->lock);
+  return 0;
+}
+
+static void shm_watch(void* impl, int peer) {
+  ((struct ShmEnd*) impl)->peer = peer;
+}
+
+static void shm_close(void* impl) {
+  struct ShmEnd* end = impl;
+  munmap(end->channel, sizeof(struct ShmChannel));
+  free(end);
+}
+
+static const struct TransportOps shm_ops = {
+    .write = shm_write,
+    .read = shm_read,
+    .watch = shm_watch,
+    .close = shm_close,
+};
+
+static void shm_ring_init(struct ShmRing* ring) {
+  pthread_mutexattr_t mutex_attr;
+  pthread_mutexattr_init(&mutex_attr);
+  pthread_mutexattr_setpshared(&mutex_attr, PTHREAD_PROCESS_SHARED);
+  pthread_mutexattr_setrobust(&mutex_attr, PTHREAD_MUTEX_ROBUST);
+  pthread_mutex_init(&ring->lock, &mutex_attr);
+  pthread_mutexattr_destroy(&mutex_attr);
+
+  pthread_condattr_t cond_attr;
+  pthread_condattr_init(&cond_attr);
+  pthread_condattr_setpshared(&cond_attr, PTHREAD_PROCESS_SHARED);
+  pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&ring->readable, &cond_attr);
+  pthread_cond_init(&ring->writable, &cond_attr);
+  pthread_condattr_destroy(&cond_attr);
+  ring->head = ring->tail = 0;
+  ring->broken = 0;
+}
+
+static int shm_pair(struct Transport* a, struct Transport* b) {
+  int fd = memfd_create("wiki_racer_transport", 0);
+  if (fd < 0 || ftruncate(fd, sizeof(struct ShmChannel)) != 0) {
+    log_error("Failed to create shared memory for a transport\n");
+    if (fd >= 0) {
+      close(fd);
+    }
+    return 1;
+  }
+  struct ShmChannel* a_map = mmap(NULL, sizeof(struct ShmChannel),
+                                  PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  struct ShmChannel* b_map = mmap(NULL, sizeof(struct ShmChannel),
+                                  PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (a_map == MAP_FAILED || b_map == MAP_FAILED) {
+    log_error("Failed to map shared memory for a transport\n");
+    if (a_map != MAP_FAILED) {
+      munmap(a_map, sizeof(struct ShmChannel));
+    }
+    if (b_map != MAP_FAILED) {
+      munmap(b_map, sizeof(struct ShmChannel));
+    }
+    return 1;
+  }
+  shm_ring_init(&a_map->rings[0]);
+  shm_ring_init(&a_map->rings[1]);
+
+  struct ShmEnd* a_end = malloc(sizeof(struct ShmEnd));
+  struct ShmEnd* b_end = malloc(sizeof(struct ShmEnd));
+  *a_end = (struct ShmEnd) {a_map, &a_map->rings[0], &a_map->rings[1], 0};
+  *b_end = (struct ShmEnd) {b_map, &b_map->rings[1], &b_map->rings[0], 0};
+  a->ops = b->ops = &shm_ops;
+  a->impl = a_end;
+  b->impl = b_end;
+  return 0;
+}
+
+// ====== Framing ===== //
+
+int transport_pair(enum TransportKind kind, struct Transport* a,
+                   struct Transport* b) {
+  memset(a, 0, sizeof(*a));
+  memset(b, 0, sizeof(*b));
+  int result = kind == TRANSPORT_SHARED_MEMORY ? shm_pair(a, b)
+                                               : socket_pair(a, b);
+  if (result != 0) {
+    return result;
+  }
+  a->received = vec_edge_init(1024);
+  b->received = vec_edge_init(1024);
+  return 0;
+}
+
+int transport_send(struct Transport* transport,
+                   const struct ShardMessage* message,
+                   const struct Edge* edges) {
+  size_t edge_bytes = (size_t) message->edge_count * sizeof(struct Edge);
+  if (transport->ops->write(transport->impl, message, sizeof(*message)) != 0 ||
+      (edge_bytes > 0 &&
+       transport->ops->write(transport->impl, edges, edge_bytes) != 0)) {
+    log_error("Failed to send a shard message\n");
+    return 1;
+  }
+  transport->bytes_sent += sizeof(*message) + edge_bytes;
+  return 0;
+}
+
+int transport_recv(struct Transport* transport, struct ShardMessage* message,
+                   const struct Edge** edges) {
+  if (transport->ops->read(transport->impl, message, sizeof(*message)) != 0) {
+    log_error("Failed to receive a shard message\n");
+    return 1;
+  }
+  struct VecEdge* received = &transport->received;
+  if (message->edge_count > received->capacity) {
+    free(received->data);
+    *received = vec_edge_init(message->edge_count);
+  }
+  size_t edge_bytes = (size_t) message->edge_count * sizeof(struct Edge);
+  if (edge_bytes > 0 &&
+      transport->ops->read(transport->impl, received->data, edge_bytes) != 0) {
+    log_error("Failed to receive a shard message\n");
+    return 1;
+  }
+  received->length = message->edge_count;
+  transport->bytes_received += sizeof(*message) + edge_bytes;
+  *edges = received->data;
+  return 0;
+}
+
+void transport_watch(struct Transport* transport, int peer) {
+  if (transport->ops->watch != NULL) {
+    transport->ops->watch(transport->impl, peer);
+  }
+}
+
+void transport_close(struct Transport* transport) {
+  if (transport->ops != NULL) {
+    transport->ops->close(transport->impl);
+  }
+  free(transport->received.data);
+  memset(transport, 0, sizeof(*transport));
+}
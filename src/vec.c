@@ -7,7 +7,7 @@ struct VecSlice vec_slice_init(unsigned long capacity) {
   return (struct VecSlice) {
       .capacity = capacity,
       .length = 0,
-      .data = malloc(capacity),
+      .data = malloc(capacity * sizeof(struct Slice)),
   };
 }
 
@@ -18,7 +18,7 @@ void vec_slice_push(struct VecSlice* vec, struct Slice val) {
     has_grown = 1;
   }
   if (has_grown) {
-    vec->data = realloc(vec->data, vec->capacity);
+    vec->data = realloc(vec->data, vec->capacity * sizeof(struct Slice));
   }
 
   vec->data[vec->length] = val;
@@ -29,7 +29,7 @@ struct VecEdge vec_edge_init(unsigned long capacity) {
   return (struct VecEdge) {
       .capacity = capacity,
       .length = 0,
-      .data = malloc(capacity),
+      .data = malloc(capacity * sizeof(struct Edge)),
   };
 }
 
@@ -40,7 +40,7 @@ void vec_edge_push(struct VecEdge* vec, struct Edge val) {
     has_grown = 1;
   }
   if (has_grown) {
-    vec->data = realloc(vec->data, vec->capacity);
+    vec->data = realloc(vec->data, vec->capacity * sizeof(struct Edge));
   }
 
   vec->data[vec->length] = val;
@@ -1,9 +1,14 @@
 #include "../src/header.h"
 #include "munit.h"
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 // ====== Helper Functions ======
 
@@ -376,8 +381,165 @@ test_parse_links_multiple_complete(const MunitParameter params[], void* data) {
   return MUNIT_OK;
 }
 
+/* Lead section and first-N link limits, which skip the rest of the text */
+// Parses page as a read of its first split bytes, then a read of the carried
+// over tail and the rest, the way build_graph_inner does
+static void parse_in_two_reads(const char* page, size_t split,
+                               const struct LinkLimits* limits,
+                               struct Interner* interner,
+                               struct VecEdge* edges) {
+  size_t length = strlen(page);
+  char* buffer = malloc(length + 1);
+  memcpy(buffer, page, split);
+  struct ParseState state = {.from_id = UINT32_MAX};
+  struct Str str = {.data = buffer, .length = split};
+  char* carry = parse_buffer_with(&str, interner, edges, &state, limits);
+  size_t carried = carry != NULL ? buffer + split - carry : 0;
+  memmove(buffer, carry, carried);
+  memcpy(buffer + carried, page + split, length - split);
+  str = (struct Str) {.data = buffer, .length = carried + length - split};
+  munit_assert_null(parse_buffer_with(&str, interner, edges, &state, limits));
+  free(buffer);
+}
+
+static MunitResult test_parse_links_with_limits(const MunitParameter params[],
+                                                void* data) {
+  (void) params;
+  (void) data;
+
+  // Long enough for the heading search to take its vector path, with a lone
+  // '=' after a newline that isn't a heading
+  const char* content = "[[A]] the lead paragraph of the page\n=x [[B|label]] "
+                        "and [[C]]\n\n== History ==\n[[D]] [[E]]</text>\n"
+                        "[[Next page]]";
+  struct {
+    struct LinkLimits limits;
+    uint32_t edge_count;
+  } cases[] = {
+      {{0, 0}, 5},
+      {{0, 1}, 3},
+      {{2, 0}, 2},
+      {{5, 1}, 3},
+  };
+  const char* expected[] = {"A", "B", "C", "D", "E"};
+  for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+    struct Interner interner = interner_init(1024);
+    struct VecEdge edges = vec_edge_init(128);
+    struct Str str = {.data = (char*) content, .length = strlen(content)};
+    uint32_t from_id = get_interned_id(&interner, "Page");
+    struct ParseState state = {.from_id = from_id, .in_text = 1};
+    char* result = parse_links_with(&str, &interner, &edges, &state,
+                                    &cases[c].limits);
+
+    munit_assert_null(result);
+    assert_edges_count(&edges, cases[c].edge_count, "links within limits");
+    for (uint32_t i = 0; i < cases[c].edge_count; i++) {
+      assert_edge_exists(&edges, from_id,
+                         get_interned_id(&interner, expected[i]),
+                         "edge within limits");
+    }
+    // The rest of the text is skipped, the next page is left to the caller
+    munit_assert_memory_equal(7, str.data, "</text>");
+
+    interner_destroy(&interner);
+    free(edges.data);
+  }
+
+  // The limits hold for a page cut in two by a read wherever the cut is, and
+  // start over for the next page
+  char page[512];
+  snprintf(page, sizeof(page),
+           "<title>Page</title><text xml:space=\"preserve\">%s"
+           "<title>Next</title><text>[[F]]</text>",
+           content);
+  size_t length = strlen(page);
+  for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+    struct Interner whole = interner_init(1024);
+    struct VecEdge whole_edges = vec_edge_init(128);
+    parse_in_two_reads(page, length, &cases[c].limits, &whole, &whole_edges);
+    assert_edges_count(&whole_edges, cases[c].edge_count + 1,
+                       "links within limits of both pages");
+    for (size_t split = 1; split < length; split++) {
+      struct Interner interner = interner_init(1024);
+      struct VecEdge edges = vec_edge_init(128);
+      parse_in_two_reads(page, split, &cases[c].limits, &interner, &edges);
+      assert_edges_count(&edges, whole_edges.length, "links over two reads");
+      munit_assert_memory_equal(edges.length * sizeof(struct Edge),
+                                edges.data, whole_edges.data);
+      interner_destroy(&interner);
+      free(edges.data);
+    }
+    interner_destroy(&whole);
+    free(whole_edges.data);
+  }
+  return MUNIT_OK;
+}
+
 /* ====== Parse Buffer Tests ====== */
 
+/* A text without links that runs past the buffer is carried over */
+static MunitResult
+test_parse_buffer_text_without_links(const MunitParameter params[],
+                                     void* data) {
+  (void) params;
+  (void) data;
+
+  struct Interner interner = interner_init(1024);
+  struct VecEdge edges = vec_edge_init(128);
+
+  const char* content = "<title>A</title><text xml:space=\"preserve\">"
+                        "{{Infobox no links yet";
+  struct Str str = {.data = (char*) content, .length = strlen(content)};
+  struct ParseState state = {.from_id = UINT32_MAX};
+  char* result = parse_buffer_with(&str, &interner, &edges, &state,
+                                   &(struct LinkLimits) {0});
+
+  munit_assert_not_null(result);
+  munit_assert_string_equal(result, "ks yet");
+  munit_assert_true(state.in_text);
+  assert_edges_count(&edges, 0, "no links yet");
+
+  // The rest of the text arrives with the next read
+  const char* rest = "ks yet [[B]]</text><text>[[C]]</text>";
+  struct Str next = {.data = (char*) rest, .length = strlen(rest)};
+  munit_assert_null(
+      parse_buffer_with(&next, &interner, &edges, &state,
+                        &(struct LinkLimits) {0}));
+  munit_assert_false(state.in_text);
+  assert_edges_count(&edges, 2, "links of both texts");
+  assert_edge_exists(&edges, get_interned_id(&interner, "A"),
+                     get_interned_id(&interner, "B"), "A -> B");
+
+  interner_destroy(&interner);
+  free(edges.data);
+  return MUNIT_OK;
+}
+
+/* Empty pages have a self closing text tag */
+static MunitResult test_parse_buffer_empty_text(const MunitParameter params[],
+                                                void* data) {
+  (void) params;
+  (void) data;
+
+  struct Interner interner = interner_init(1024);
+  struct VecEdge edges = vec_edge_init(128);
+
+  const char* content = "<title>Empty</title><text bytes=\"0\" />"
+                        "<title>Full</title><text>[[Link]]</text>";
+  struct Str str = {.data = (char*) content, .length = strlen(content)};
+  struct ParseState state = {.from_id = UINT32_MAX};
+  munit_assert_null(parse_buffer_with(&str, &interner, &edges, &state,
+                                      &(struct LinkLimits) {0}));
+
+  assert_edges_count(&edges, 1, "only the full page links");
+  assert_edge_exists(&edges, get_interned_id(&interner, "Full"),
+                     get_interned_id(&interner, "Link"), "Full -> Link");
+
+  interner_destroy(&interner);
+  free(edges.data);
+  return MUNIT_OK;
+}
+
 /* Test 9: Parse buffer with title tag */
 static MunitResult test_parse_buffer_title_tag(const MunitParameter params[],
                                                void* data) {
@@ -461,8 +623,10 @@ static MunitResult test_integration_simple_case(const MunitParameter params[],
   struct Str str = {.data = content, .length = strlen(content)};
   fwrite(str.data, 1, str.length, xml_file);
   fseek(xml_file, 0, SEEK_SET);
+  struct BuildOptions build_options = build_options_default();
   build_graph_inner(xml_file, BUFF_SIZE, &interner, &edges,
-                    "./tmp_test_out/test_integration_simple_case");
+                    "./tmp_test_out/test_integration_simple_case",
+                    &build_options);
   munit_assert_size(interner.strs.length, ==, 3);
 
   char* title = "Page";
@@ -488,6 +652,1277 @@ static MunitResult test_integration_simple_case(const MunitParameter params[],
   return MUNIT_OK;
 }
 
+static MunitResult
+test_integration_multiple_pages(const MunitParameter params[], void* data) {
+  (void) params;
+  (void) data;
+
+  struct Interner interner = interner_init(1024);
+  struct VecEdge edges = vec_edge_init(128);
+
+  const char* content =
+      "<page><title>First</title><text>[[Alpha]] and [[Beta]]</text></page>"
+      "<page><title>Second</title><text>[[Gamma|label]]</text></page>";
+  FILE* xml_file = create_test_file(content, strlen(content));
+  struct BuildOptions build_options = build_options_default();
+  build_graph_inner(xml_file, BUFF_SIZE, &interner, &edges,
+                    "./tmp_test_out/test_integration_multiple_pages",
+                    &build_options);
+
+  uint32_t first_id = get_interned_id(&interner, "First");
+  uint32_t second_id = get_interned_id(&interner, "Second");
+  assert_edges_count(&edges, 3, "links of both pages");
+  assert_edge_exists(&edges, first_id, get_interned_id(&interner, "Alpha"),
+                     "First -> Alpha");
+  assert_edge_exists(&edges, first_id, get_interned_id(&interner, "Beta"),
+                     "First -> Beta");
+  assert_edge_exists(&edges, second_id, get_interned_id(&interner, "Gamma"),
+                     "Second -> Gamma");
+
+  interner_destroy(&interner);
+  free(edges.data);
+  fclose(xml_file);
+  return MUNIT_OK;
+}
+
+/* ====== Synthetic Dump Tests ====== */
+
+static char* read_whole_file(FILE* file, size_t* out_len) {
+  fseek(file, 0, SEEK_END);
+  *out_len = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  char* contents = malloc(*out_len);
+  munit_assert_size(fread(contents, 1, *out_len, file), ==, *out_len);
+  fseek(file, 0, SEEK_SET);
+  return contents;
+}
+
+static MunitResult test_synth_dump_deterministic(const MunitParameter params[],
+                                                 void* data) {
+  (void) params;
+  (void) data;
+
+  struct SynthDumpOptions options = synth_dump_default_options();
+  options.page_count = 200;
+
+  FILE* first = tmpfile();
+  FILE* second = tmpfile();
+  munit_assert_int(synth_dump_write(first, &options), ==, 0);
+  munit_assert_int(synth_dump_write(second, &options), ==, 0);
+
+  size_t first_len, second_len;
+  char* first_contents = read_whole_file(first, &first_len);
+  char* second_contents = read_whole_file(second, &second_len);
+  munit_assert_size(first_len, ==, second_len);
+  munit_assert_memory_equal(first_len, first_contents, second_contents);
+
+  // Every page is parsed and has its links attached
+  struct Interner interner = interner_init(1 << 16);
+  struct VecEdge edges = vec_edge_init(1 << 12);
+  struct BuildOptions build_options = build_options_default();
+  build_graph_inner(first, BUFF_SIZE, &interner, &edges,
+                    "./tmp_test_out/test_synth_dump_deterministic",
+                    &build_options);
+  munit_assert_uint32(interner.strs.length, >=, options.page_count / 2);
+  munit_assert_uint32(edges.length, >=, options.page_count);
+
+  interner_destroy(&interner);
+  free(edges.data);
+  free(first_contents);
+  free(second_contents);
+  fclose(first);
+  fclose(second);
+  return MUNIT_OK;
+}
+
+// Parses the whole file with buff_size byte reads into interner and edges
+static void build_with_buffer(FILE* xml_file, uint64_t buff_size,
+                              const struct BuildOptions* build_options,
+                              struct Interner* interner,
+                              struct VecEdge* edges) {
+  *interner = interner_init(1 << 16);
+  *edges = vec_edge_init(1 << 12);
+  fseek(xml_file, 0, SEEK_SET);
+  munit_assert_int(build_graph_inner(xml_file, buff_size, interner, edges,
+                                     "./tmp_test_out/test_small_buffers",
+                                     build_options),
+                   ==, 0);
+}
+
+static MunitResult test_synth_small_buffers(const MunitParameter params[],
+                                            void* data) {
+  (void) params;
+  (void) data;
+
+  struct SynthDumpOptions options = synth_dump_default_options();
+  options.page_count = 200;
+  FILE* xml_file = tmpfile();
+  munit_assert_int(synth_dump_write(xml_file, &options), ==, 0);
+  const struct LinkLimits limits[] = {{0, 0}, {0, 1}, {3, 0}, {3, 1}};
+  for (size_t l = 0; l < sizeof(limits) / sizeof(limits[0]); l++) {
+    struct BuildOptions build_options = build_options_default();
+    build_options.link_limits = limits[l];
+    struct Interner whole;
+    struct VecEdge whole_edges;
+    build_with_buffer(xml_file, BUFF_SIZE, &build_options, &whole,
+                      &whole_edges);
+
+    // Pages, titles, links and closing tags all end up cut by some read, and
+    // the graph must not depend on where
+    const uint64_t buff_sizes[] = {65536, 16384, 4096, 1021};
+    for (size_t i = 0; i < sizeof(buff_sizes) / sizeof(buff_sizes[0]); i++) {
+      struct Interner interner;
+      struct VecEdge edges;
+      build_with_buffer(xml_file, buff_sizes[i], &build_options, &interner,
+                        &edges);
+      munit_assert_uint32(interner.strs.length, ==, whole.strs.length);
+      munit_assert_uint32(edges.length, ==, whole_edges.length);
+      munit_assert_memory_equal(edges.length * sizeof(struct Edge),
+                                edges.data, whole_edges.data);
+      interner_destroy(&interner);
+      free(edges.data);
+    }
+    interner_destroy(&whole);
+    free(whole_edges.data);
+  }
+  fclose(xml_file);
+  return MUNIT_OK;
+}
+
+/* ====== Graph File Tests ====== */
+
+// Checks that every interned title round trips through the view and that ids
+// are the ranks of the titles in sorted order
+static void assert_view_matches_interner(struct Graph* graph,
+                                         struct Interner* interner) {
+  char scratch[TITLE_MAX_LENGTH];
+  char previous[TITLE_MAX_LENGTH] = {0};
+  munit_assert_uint32(graph->node_count, ==, interner->strs.length);
+  for (uint32_t id = 0; id < graph->node_count; id++) {
+    struct Str title = interner_view_get(&graph->titles, id, scratch);
+    munit_assert_size(strlen(title.data), ==, title.length);
+    if (id > 0) {
+      munit_assert_int(strcmp(previous, title.data), <, 0);
+    }
+    strcpy(previous, title.data);
+  }
+  for (uint32_t i = 0; i < interner->strs.length; i++) {
+    struct Slice slice = interner->strs.data[i];
+    const char* expected = arena_get_slice(&interner->arena, slice);
+    uint32_t id = interner_view_find(&graph->titles, expected, slice.length);
+    munit_assert_uint32(id, <, graph->node_count);
+    munit_assert_string_equal(
+        interner_view_get(&graph->titles, id, scratch).data, expected);
+  }
+  munit_assert_uint32(interner_view_find(&graph->titles, "Missing", 7), ==,
+                      UINT32_MAX);
+}
+
+static MunitResult test_graph_write_and_open(const MunitParameter params[],
+                                             void* data) {
+  (void) params;
+  (void) data;
+
+  struct Interner interner = interner_init(1024);
+  struct VecEdge edges = vec_edge_init(128);
+
+  const char* content =
+      "<page><title>First</title><text>[[Beta]] [[Alpha]] [[Beta]]</text>"
+      "</page><page><title>Alpha</title><text>[[First]]</text></page>";
+  FILE* xml_file = create_test_file(content, strlen(content));
+  char* path = "./tmp_test_out/test_graph_write_and_open";
+  struct BuildOptions build_options = build_options_default();
+  munit_assert_int(build_graph_inner(xml_file, BUFF_SIZE, &interner, &edges,
+                                     path, &build_options),
+                   ==, 0);
+
+  struct Graph graph;
+  munit_assert_int(graph_open(&graph, path), ==, 0);
+  assert_view_matches_interner(&graph, &interner);
+
+  // Plain titles resolve through the mapping without copying
+  char scratch[TITLE_MAX_LENGTH];
+  struct Str title = interner_view_get(&graph.titles, 0, scratch);
+  munit_assert_string_equal(title.data, "Alpha");
+  munit_assert_ptr_equal(title.data, graph.titles.bytes);
+
+  // Ids are sorted by title: Alpha, Beta, First. Adjacency lists are sorted
+  // with duplicate links removed.
+  munit_assert_uint32(graph.edge_count, ==, 3);
+  munit_assert_uint32(graph.out_offsets[3] - graph.out_offsets[2], ==, 2);
+  munit_assert_uint32(graph.out_targets[graph.out_offsets[2]], ==, 0);
+  munit_assert_uint32(graph.out_targets[graph.out_offsets[2] + 1], ==, 1);
+  munit_assert_uint32(graph.out_targets[graph.out_offsets[0]], ==, 2);
+
+  // The reverse CSR lists the pages linking to each node
+  munit_assert_uint32(graph.in_offsets[1] - graph.in_offsets[0], ==, 1);
+  munit_assert_uint32(graph.in_targets[graph.in_offsets[0]], ==, 2);
+  munit_assert_uint32(graph.in_targets[graph.in_offsets[2]], ==, 0);
+
+  graph_close(&graph);
+  interner_destroy(&interner);
+  free(edges.data);
+  fclose(xml_file);
+  return MUNIT_OK;
+}
+
+static MunitResult test_graph_long_titles(const MunitParameter params[],
+                                          void* data) {
+  (void) params;
+  (void) data;
+
+  struct Interner interner = interner_init(1024);
+  struct VecEdge edges = vec_edge_init(128);
+  char long_title[TITLE_MAX_LENGTH + 16];
+  memset(long_title, 'x', sizeof(long_title) - 1);
+  long_title[sizeof(long_title) - 1] = '\0';
+
+  // Links too long to be a title are dropped
+  char content[TITLE_MAX_LENGTH + 64];
+  snprintf(content, sizeof(content), "[[%s]] [[Short]]", long_title);
+  struct Str str = {.data = content, .length = strlen(content)};
+  uint32_t from_id = get_interned_id(&interner, "Page");
+  munit_assert_null(parse_links(&str, &interner, &edges, from_id));
+  assert_edges_count(&edges, 1, "only the short link");
+  munit_assert_uint32(interner.strs.length, ==, 2);
+
+  // Titles too long for a view are rejected for either encoding
+  intern_from_cstr(&interner, long_title, strlen(long_title));
+  struct BuildOptions build_options = build_options_default();
+  munit_assert_int(graph_write("./tmp_test_out/test_graph_long_titles",
+                               &interner, &edges, &build_options),
+                   ==, 1);
+  build_options.title_encoding = TITLE_ENCODING_FRONT_CODED;
+  munit_assert_int(graph_write("./tmp_test_out/test_graph_long_titles",
+                               &interner, &edges, &build_options),
+                   ==, 1);
+
+  interner_destroy(&interner);
+  free(edges.data);
+  return MUNIT_OK;
+}
+
+static MunitResult test_graph_front_coded(const MunitParameter params[],
+                                          void* data) {
+  (void) params;
+  (void) data;
+
+  struct SynthDumpOptions options = synth_dump_default_options();
+  options.page_count = 300;
+  FILE* xml_file = tmpfile();
+  munit_assert_int(synth_dump_write(xml_file, &options), ==, 0);
+
+  struct Interner interner = interner_init(1 << 16);
+  struct VecEdge edges = vec_edge_init(1 << 12);
+  struct BuildOptions build_options = build_options_default();
+  char* plain_path = "./tmp_test_out/test_graph_front_coded_plain";
+  char* front_coded_path = "./tmp_test_out/test_graph_front_coded";
+  fseek(xml_file, 0, SEEK_SET);
+  munit_assert_int(build_graph_inner(xml_file, BUFF_SIZE, &interner, &edges,
+                                     plain_path, &build_options),
+                   ==, 0);
+  build_options.title_encoding = TITLE_ENCODING_FRONT_CODED;
+  munit_assert_int(graph_write(front_coded_path, &interner, &edges,
+                               &build_options),
+                   ==, 0);
+
+  struct Graph plain;
+  struct Graph front_coded;
+  munit_assert_int(graph_open(&plain, plain_path), ==, 0);
+  munit_assert_int(graph_open(&front_coded, front_coded_path), ==, 0);
+  munit_assert_int(front_coded.titles.encoding, ==,
+                   TITLE_ENCODING_FRONT_CODED);
+  assert_view_matches_interner(&front_coded, &interner);
+
+  // Same ids and edges either way, only the string table differs
+  char plain_scratch[TITLE_MAX_LENGTH];
+  char front_coded_scratch[TITLE_MAX_LENGTH];
+  for (uint32_t id = 0; id < plain.node_count; id++) {
+    munit_assert_string_equal(
+        interner_view_get(&plain.titles, id, plain_scratch).data,
+        interner_view_get(&front_coded.titles, id, front_coded_scratch).data);
+  }
+  munit_assert_uint32(front_coded.edge_count, ==, plain.edge_count);
+  munit_assert_memory_equal(plain.edge_count * sizeof(uint32_t),
+                            plain.out_targets, front_coded.out_targets);
+  munit_assert_uint64(
+      front_coded.header->sections[GRAPH_SECTION_TITLE_BYTES].length, <,
+      plain.header->sections[GRAPH_SECTION_TITLE_BYTES].length);
+
+  graph_close(&plain);
+  graph_close(&front_coded);
+  interner_destroy(&interner);
+  free(edges.data);
+  fclose(xml_file);
+  return MUNIT_OK;
+}
+
+/* ====== SCC and Search Tests ====== */
+
+static MunitResult test_scc_tarjan(const MunitParameter params[], void* data) {
+  (void) params;
+  (void) data;
+
+  // 0 <-> 1 -> 2 <-> 3, 4 -> 0, 5 alone
+  uint32_t offsets[] = {0, 1, 3, 4, 5, 6, 6};
+  uint32_t targets[] = {1, 0, 2, 3, 2, 0};
+  uint32_t component[6];
+  uint32_t count = scc_tarjan(6, offsets, targets, component);
+
+  munit_assert_uint32(count, ==, 4);
+  munit_assert_uint32(component[0], ==, component[1]);
+  munit_assert_uint32(component[2], ==, component[3]);
+  munit_assert_uint32(component[0], !=, component[2]);
+  // Edges between components always go to a lower id
+  for (uint32_t node = 0; node < 6; node++) {
+    for (uint32_t i = offsets[node]; i < offsets[node + 1]; i++) {
+      munit_assert_uint32(component[node], >=, component[targets[i]]);
+    }
+  }
+  return MUNIT_OK;
+}
+
+static uint32_t find_id(struct Graph* graph, const char* title) {
+  uint32_t id = interner_view_find(&graph->titles, title, strlen(title));
+  munit_assert_uint32(id, !=, UINT32_MAX);
+  return id;
+}
+
+static MunitResult test_search_shortest_path(const MunitParameter params[],
+                                             void* data) {
+  (void) params;
+  (void) data;
+
+  struct Interner interner = interner_init(1024);
+  struct VecEdge edges = vec_edge_init(128);
+  const char* content =
+      "<page><title>A</title><text>[[B]] [[C]]</text></page>"
+      "<page><title>B</title><text>[[D]]</text></page>"
+      "<page><title>C</title><text>[[D]] [[A]]</text></page>"
+      "<page><title>D</title><text>[[E]]</text></page>"
+      "<page><title>E</title><text>[[D]]</text></page>"
+      "<page><title>F</title><text>[[A]]</text></page>";
+  FILE* xml_file = create_test_file(content, strlen(content));
+  char* path = "./tmp_test_out/test_search_shortest_path";
+  struct BuildOptions build_options = build_options_default();
+  munit_assert_int(build_graph_inner(xml_file, BUFF_SIZE, &interner, &edges,
+                                     path, &build_options),
+                   ==, 0);
+
+  struct Graph graph;
+  munit_assert_int(graph_open(&graph, path), ==, 0);
+  munit_assert_uint32(graph.component_count, ==, 4);
+  struct SearchState state = search_state_init(&graph);
+  uint32_t result[SEARCH_MAX_PATH];
+
+  uint32_t a = find_id(&graph, "A");
+  uint32_t e = find_id(&graph, "E");
+  uint32_t f = find_id(&graph, "F");
+  munit_assert_uint32(search_shortest_path(&graph, &state, a, e, result), ==,
+                      4);
+  munit_assert_uint32(result[0], ==, a);
+  munit_assert_uint32(result[3], ==, e);
+  munit_assert_uint32(search_shortest_path(&graph, &state, f, e, result), ==,
+                      5);
+
+  // Rejected from the component index without searching
+  munit_assert_int(graph_reachability(&graph, e, a), ==, REACHABILITY_NO);
+  munit_assert_int(graph_reachability(&graph, a, f), ==, REACHABILITY_NO);
+  munit_assert_uint32(search_shortest_path(&graph, &state, e, a, result), ==,
+                      0);
+  munit_assert_uint32(state.nodes_visited, ==, 0);
+  munit_assert_uint32(search_shortest_path(&graph, &state, a, a, result), ==,
+                      1);
+
+  search_state_destroy(&state);
+  graph_close(&graph);
+  interner_destroy(&interner);
+  free(edges.data);
+  fclose(xml_file);
+  return MUNIT_OK;
+}
+
+// Plain BFS without any index, returns the distance or UINT32_MAX
+static uint32_t reference_distance(struct Graph* graph, uint32_t source,
+                                   uint32_t target) {
+  uint32_t* distance = malloc(graph->node_count * sizeof(uint32_t));
+  uint32_t* queue = malloc(graph->node_count * sizeof(uint32_t));
+  for (uint32_t i = 0; i < graph->node_count; i++) {
+    distance[i] = UINT32_MAX;
+  }
+  uint32_t head = 0;
+  uint32_t tail = 0;
+  distance[source] = 0;
+  queue[tail++] = source;
+  while (head < tail) {
+    uint32_t node = queue[head++];
+    for (uint32_t i = graph->out_offsets[node];
+         i < graph->out_offsets[node + 1]; i++) {
+      uint32_t next = graph->out_targets[i];
+      if (distance[next] == UINT32_MAX) {
+        distance[next] = distance[node] + 1;
+        queue[tail++] = next;
+      }
+    }
+  }
+  uint32_t result = distance[target];
+  free(distance);
+  free(queue);
+  return result;
+}
+
+// Opens a graph built from a synthetic dump of page_count pages, followed by
+// the XML in extra unless it's NULL
+static void open_synthetic_graph_with(struct Graph* graph, uint32_t page_count,
+                                      const char* extra, char* path) {
+  struct SynthDumpOptions options = synth_dump_default_options();
+  options.page_count = page_count;
+  FILE* xml_file = tmpfile();
+  munit_assert_int(synth_dump_write(xml_file, &options), ==, 0);
+  if (extra != NULL) {
+    fputs(extra, xml_file);
+  }
+  fseek(xml_file, 0, SEEK_SET);
+
+  struct Interner interner = interner_init(1 << 16);
+  struct VecEdge edges = vec_edge_init(1 << 12);
+  struct BuildOptions build_options = build_options_default();
+  munit_assert_int(build_graph_inner(xml_file, BUFF_SIZE, &interner, &edges,
+                                     path, &build_options),
+                   ==, 0);
+  interner_destroy(&interner);
+  free(edges.data);
+  fclose(xml_file);
+  munit_assert_int(graph_open(graph, path), ==, 0);
+}
+
+static void open_synthetic_graph(struct Graph* graph, uint32_t page_count,
+                                 char* path) {
+  open_synthetic_graph_with(graph, page_count, NULL, path);
+}
+
+static MunitResult test_search_matches_reference(const MunitParameter params[],
+                                                 void* data) {
+  (void) params;
+  (void) data;
+
+  struct Graph graph;
+  open_synthetic_graph(&graph, 300,
+                       "./tmp_test_out/test_search_matches_reference");
+  struct SearchState state = search_state_init(&graph);
+  state.prefetch_distance = SEARCH_PREFETCH_DISTANCE;
+  struct SearchState plain = search_state_init(&graph);
+  uint32_t result[SEARCH_MAX_PATH];
+  uint32_t plain_result[SEARCH_MAX_PATH];
+
+  for (uint32_t i = 0; i < 200; i++) {
+    uint32_t source = (i * 7919) % graph.node_count;
+    uint32_t target = (i * 104729 + 13) % graph.node_count;
+    uint32_t expected = reference_distance(&graph, source, target);
+    uint32_t length =
+        search_shortest_path(&graph, &state, source, target, result);
+    // Prefetching mustn't change which path is found
+    munit_assert_uint32(
+        search_shortest_path(&graph, &plain, source, target, plain_result), ==,
+        length);
+    munit_assert_memory_equal(length * sizeof(uint32_t), result,
+                              plain_result);
+    if (expected == UINT32_MAX) {
+      munit_assert_uint32(length, ==, 0);
+      munit_assert_int(graph_reachability(&graph, source, target), !=,
+                       REACHABILITY_YES);
+    } else {
+      munit_assert_uint32(length, ==, expected + 1);
+      munit_assert_int(graph_reachability(&graph, source, target), !=,
+                       REACHABILITY_NO);
+    }
+  }
+
+  search_state_destroy(&state);
+  search_state_destroy(&plain);
+  graph_close(&graph);
+  return MUNIT_OK;
+}
+
+// Plain BFS that never enters a banned node, UINT32_MAX when unreachable
+static uint32_t reference_constrained_distance(struct Graph* graph,
+                                               const uint64_t* banned,
+                                               uint32_t source,
+                                               uint32_t target) {
+  uint32_t* distance = malloc(graph->node_count * sizeof(uint32_t));
+  uint32_t* queue = malloc(graph->node_count * sizeof(uint32_t));
+  for (uint32_t i = 0; i < graph->node_count; i++) {
+    distance[i] = UINT32_MAX;
+  }
+  uint32_t head = 0;
+  uint32_t tail = 0;
+  distance[source] = 0;
+  queue[tail++] = source;
+  while (head < tail) {
+    uint32_t node = queue[head++];
+    for (uint32_t i = graph->out_offsets[node];
+         i < graph->out_offsets[node + 1]; i++) {
+      uint32_t next = graph->out_targets[i];
+      if (distance[next] == UINT32_MAX &&
+          !((banned[next >> 6] >> (next & 63)) & 1)) {
+        distance[next] = distance[node] + 1;
+        queue[tail++] = next;
+      }
+    }
+  }
+  uint32_t result = distance[target];
+  free(distance);
+  free(queue);
+  return result;
+}
+
+static MunitResult test_search_constraints(const MunitParameter params[],
+                                           void* data) {
+  (void) params;
+  (void) data;
+
+  struct Graph graph;
+  open_synthetic_graph(&graph, 300, "./tmp_test_out/test_constraints_graph");
+  struct NodeMaskSpec specs[3];
+  munit_assert_int(node_mask_spec_parse(&specs[0], "lists=title:List of *"),
+                   ==, 0);
+  munit_assert_int(node_mask_spec_parse(&specs[1], "years=title:[0-9]*"), ==,
+                   0);
+  munit_assert_int(node_mask_spec_parse(&specs[2], "categorised=category:*"),
+                   ==, 0);
+  munit_assert_int(node_mask_spec_parse(&specs[0], "bad=pattern:x"), !=, 0);
+  munit_assert_int(node_mask_spec_parse(&specs[0], "lists=title:List of *"),
+                   ==, 0);
+  munit_assert_int(node_masks_build(&graph, "./tmp_test_out/test_masks",
+                                    specs, 3),
+                   ==, 0);
+  struct NodeMasks masks;
+  munit_assert_int(
+      node_masks_open(&masks, "./tmp_test_out/test_masks", &graph), ==, 0);
+
+  // Masks against the titles and category links they were built from
+  const uint64_t* lists = node_masks_find(&masks, "lists", 5);
+  const uint64_t* categorised = node_masks_find(&masks, "categorised", 11);
+  munit_assert_not_null(lists);
+  munit_assert_not_null(categorised);
+  munit_assert_null(node_masks_find(&masks, "list", 4));
+  char scratch[TITLE_MAX_LENGTH];
+  uint32_t list_count = 0;
+  for (uint32_t node = 0; node < graph.node_count; node++) {
+    struct Str title = interner_view_get(&graph.titles, node, scratch);
+    int is_list = strncmp(title.data, "List of ", 8) == 0;
+    munit_assert_int((int) ((lists[node >> 6] >> (node & 63)) & 1), ==,
+                     is_list);
+    list_count += is_list;
+    int in_category = 0;
+    for (uint32_t i = graph.out_offsets[node];
+         i < graph.out_offsets[node + 1]; i++) {
+      struct Str linked =
+          interner_view_get(&graph.titles, graph.out_targets[i], scratch);
+      in_category |= strncmp(linked.data, "Category:", 9) == 0;
+    }
+    munit_assert_int((int) ((categorised[node >> 6] >> (node & 63)) & 1), ==,
+                     in_category);
+  }
+  munit_assert_uint32(list_count, >, 0);
+
+  uint64_t* banned = calloc(masks.words, sizeof(uint64_t));
+  munit_assert_int(node_masks_compile(&masks, "nope", banned), !=, 0);
+  munit_assert_int(
+      node_masks_compile(&masks, "lists | years&!categorised", banned), ==, 0);
+  struct SearchState state = search_state_init(&graph);
+  uint32_t path[SEARCH_MAX_PATH];
+  // A tight hop limit, then the widest one
+  uint32_t hop_limits[] = {3, SEARCH_MAX_PATH - 1};
+  for (uint32_t h = 0; h < 2; h++) {
+    uint32_t hops = hop_limits[h];
+    struct SearchConstraints constraints = {.banned = banned,
+                                            .max_hops = hops};
+    search_state_constrain(&state, &graph, &constraints);
+    for (uint32_t i = 0; i < 300; i++) {
+      uint32_t source = (i * 7919) % graph.node_count;
+      uint32_t target = (i * 104729 + 13) % graph.node_count;
+      uint32_t expected =
+          reference_constrained_distance(&graph, banned, source, target);
+      int endpoint_banned = ((banned[source >> 6] >> (source & 63)) & 1) ||
+                            ((banned[target >> 6] >> (target & 63)) & 1);
+      if (endpoint_banned || expected > hops) {
+        expected = UINT32_MAX;
+      }
+      uint32_t length =
+          search_shortest_path(&graph, &state, source, target, path);
+      munit_assert_uint32(length, ==,
+                          expected == UINT32_MAX ? 0 : expected + 1);
+      for (uint32_t j = 0; j < length; j++) {
+        munit_assert_false((banned[path[j] >> 6] >> (path[j] & 63)) & 1);
+      }
+    }
+  }
+
+  // Back to unconstrained, the banned nodes must not linger in visited
+  struct SearchConstraints none = search_constraints_none();
+  search_state_constrain(&state, &graph, &none);
+  for (uint32_t i = 0; i < 100; i++) {
+    uint32_t source = (i * 7919) % graph.node_count;
+    uint32_t target = (i * 104729 + 13) % graph.node_count;
+    uint32_t expected = reference_distance(&graph, source, target);
+    munit_assert_uint32(
+        search_shortest_path(&graph, &state, source, target, path), ==,
+        expected == UINT32_MAX ? 0 : expected + 1);
+  }
+
+  // Hop limits alone skip the bitmap, visited stays clear between them
+  for (uint32_t h = 0; h < 2; h++) {
+    struct SearchConstraints hops_only = {.banned = NULL,
+                                          .max_hops = hop_limits[h]};
+    search_state_constrain(&state, &graph, &hops_only);
+    for (uint32_t i = 0; i < 100; i++) {
+      uint32_t source = (i * 7919) % graph.node_count;
+      uint32_t target = (i * 104729 + 13) % graph.node_count;
+      uint32_t expected = reference_distance(&graph, source, target);
+      if (expected > hop_limits[h]) {
+        expected = UINT32_MAX;
+      }
+      munit_assert_uint32(
+          search_shortest_path(&graph, &state, source, target, path), ==,
+          expected == UINT32_MAX ? 0 : expected + 1);
+    }
+  }
+
+  free(banned);
+  search_state_destroy(&state);
+  node_masks_close(&masks);
+  graph_close(&graph);
+  return MUNIT_OK;
+}
+
+/* ====== Landmark Label Tests ====== */
+
+static MunitResult test_labels_match_reference(const MunitParameter params[],
+                                               void* data) {
+  (void) params;
+  (void) data;
+
+  struct Graph graph;
+  open_synthetic_graph(&graph, 300, "./tmp_test_out/test_labels_graph");
+  munit_assert_int(
+      label_index_build(&graph, "./tmp_test_out/test_labels_serial", 1), ==,
+      0);
+  munit_assert_int(
+      label_index_build(&graph, "./tmp_test_out/test_labels_parallel", 2), ==,
+      0);
+
+  // Running both directions in parallel gives the same labels
+  struct LabelIndex serial;
+  struct LabelIndex parallel;
+  munit_assert_int(
+      label_index_open(&serial, "./tmp_test_out/test_labels_serial", &graph),
+      ==, 0);
+  munit_assert_int(label_index_open(&parallel,
+                                    "./tmp_test_out/test_labels_parallel",
+                                    &graph),
+                   ==, 0);
+  munit_assert_size(serial.map_length, ==, parallel.map_length);
+  munit_assert_memory_equal(serial.map_length, serial.map, parallel.map);
+
+  uint32_t result[SEARCH_MAX_PATH];
+  for (uint32_t i = 0; i < 300; i++) {
+    uint32_t source = (i * 7919) % graph.node_count;
+    uint32_t target = (i * 104729 + 13) % graph.node_count;
+    uint32_t expected = reference_distance(&graph, source, target);
+    munit_assert_uint32(label_distance(&serial, source, target), ==, expected);
+
+    uint32_t length =
+        label_shortest_path(&graph, &serial, source, target, result);
+    munit_assert_uint32(length, ==,
+                        expected == UINT32_MAX ? 0 : expected + 1);
+    for (uint32_t j = 0; j + 1 < length; j++) {
+      munit_assert_uint32(reference_distance(&graph, result[j], result[j + 1]),
+                          ==, 1);
+    }
+  }
+
+  // Batches of hubs prune less, the labels are bigger but just as exact
+  munit_assert_int(
+      label_index_build(&graph, "./tmp_test_out/test_labels_batched", 8), ==,
+      0);
+  struct LabelIndex batched;
+  munit_assert_int(label_index_open(&batched,
+                                    "./tmp_test_out/test_labels_batched",
+                                    &graph),
+                   ==, 0);
+  munit_assert_uint64(batched.header->out_entries + batched.header->in_entries,
+                      >=,
+                      serial.header->out_entries + serial.header->in_entries);
+  for (uint32_t i = 0; i < 300; i++) {
+    uint32_t source = (i * 7919) % graph.node_count;
+    uint32_t target = (i * 104729 + 13) % graph.node_count;
+    munit_assert_uint32(label_distance(&batched, source, target), ==,
+                        reference_distance(&graph, source, target));
+  }
+
+  label_index_close(&serial);
+  label_index_close(&parallel);
+  label_index_close(&batched);
+  graph_close(&graph);
+  return MUNIT_OK;
+}
+
+static MunitResult test_graph_load_options(const MunitParameter params[],
+                                           void* data) {
+  (void) params;
+  (void) data;
+
+  struct Graph plain;
+  open_synthetic_graph(&plain, 200, "./tmp_test_out/test_load_graph");
+  struct GraphLoadOptions options[] = {
+      {1, 0, GRAPH_HUGE_PAGES_NONE},
+      {3, 1, GRAPH_HUGE_PAGES_NONE},
+      {2, 0, GRAPH_HUGE_PAGES_TRANSPARENT},
+      // Falls back to transparent huge pages when none are reserved
+      {0, 1, GRAPH_HUGE_PAGES_EXPLICIT},
+  };
+  size_t length = plain.header->sections[GRAPH_SECTION_SCC_FLAGS].offset +
+                  plain.header->sections[GRAPH_SECTION_SCC_FLAGS].length;
+  for (uint32_t i = 0; i < sizeof(options) / sizeof(options[0]); i++) {
+    struct Graph graph;
+    munit_assert_int(graph_open_with(&graph, "./tmp_test_out/test_load_graph",
+                                     &options[i]),
+                     ==, 0);
+    munit_assert_uint32(graph.node_count, ==, plain.node_count);
+    munit_assert_memory_equal(length, graph.map, plain.map);
+    graph_close(&graph);
+  }
+  graph_close(&plain);
+  return MUNIT_OK;
+}
+
+/* ====== Query Cache Tests ====== */
+
+static MunitResult test_query_cache_matches_search(
+    const MunitParameter params[], void* data) {
+  (void) params;
+  (void) data;
+
+  struct Graph graph;
+  open_synthetic_graph(&graph, 300, "./tmp_test_out/test_cache_graph");
+  struct SearchState state = search_state_init(&graph);
+  // Room for two trees and a handful of pairs, so both levels evict
+  struct QueryCacheOptions options = {
+      .tree_budget_bytes = 2 * graph.node_count * 5,
+      .tree_admit_after = 3,
+      .pair_budget_bytes = 2048,
+  };
+  struct QueryCache* cache = query_cache_init(&graph, &options);
+
+  uint32_t path[SEARCH_MAX_PATH];
+  uint32_t expected[SEARCH_MAX_PATH];
+  for (uint32_t i = 0; i < 2000; i++) {
+    // A few hot targets, and pairs that repeat now and then
+    uint32_t source = (i % 37 * 7919) % graph.node_count;
+    uint32_t target = i % 3 == 0 ? (i % 5) * 11 % graph.node_count
+                                 : (i * 104729 + 13) % 97 % graph.node_count;
+    uint32_t expected_length =
+        search_shortest_path(&graph, &state, source, target, expected);
+    uint32_t length = query_cache_lookup(cache, source, target, path);
+    query_cache_build_trees(cache);
+    if (length == QUERY_CACHE_MISS) {
+      query_cache_insert(cache, source, target, expected, expected_length);
+      continue;
+    }
+    munit_assert_uint32(length, ==, expected_length);
+    if (length > 0) {
+      munit_assert_uint32(path[0], ==, source);
+      munit_assert_uint32(path[length - 1], ==, target);
+    }
+    for (uint32_t j = 0; j + 1 < length; j++) {
+      munit_assert_uint32(reference_distance(&graph, path[j], path[j + 1]), ==,
+                          1);
+    }
+  }
+
+  struct QueryCacheStats stats = query_cache_stats(cache);
+  munit_assert_uint64(stats.lookups, ==, 2000);
+  munit_assert_uint64(stats.tree_hits, >, 0);
+  munit_assert_uint64(stats.pair_hits, >, 0);
+  munit_assert_uint64(stats.tree_evictions, >, 0);
+  munit_assert_uint64(stats.pair_evictions, >, 0);
+  munit_assert_size(stats.tree_bytes, <=, options.tree_budget_bytes);
+  munit_assert_size(stats.pair_bytes, <=, options.pair_budget_bytes);
+
+  query_cache_destroy(cache);
+  search_state_destroy(&state);
+  graph_close(&graph);
+  return MUNIT_OK;
+}
+
+// Lookups only queue hot targets, the tree is built by the separate call
+static MunitResult test_query_cache_deferred_trees(
+    const MunitParameter params[], void* data) {
+  (void) params;
+  (void) data;
+
+  struct Graph graph;
+  open_synthetic_graph(&graph, 100, "./tmp_test_out/test_cache_deferred");
+  struct QueryCacheOptions options = query_cache_default_options();
+  options.tree_admit_after = 2;
+  options.pair_budget_bytes = 4096;
+  struct QueryCache* cache = query_cache_init(&graph, &options);
+  struct QueryCacheStats stats = query_cache_stats(cache);
+  munit_assert_size(stats.pair_bytes, >, 0);
+  munit_assert_size(stats.pair_bytes, <=, options.pair_budget_bytes);
+
+  uint32_t path[SEARCH_MAX_PATH];
+  uint32_t target = 1;
+  for (uint32_t i = 0; i < 3; i++) {
+    munit_assert_uint32(query_cache_lookup(cache, i + 2, target, path), ==,
+                        QUERY_CACHE_MISS);
+  }
+  munit_assert_uint64(query_cache_stats(cache).trees_built, ==, 0);
+  munit_assert_uint32(query_cache_build_trees(cache), ==, 1);
+  munit_assert_uint32(query_cache_build_trees(cache), ==, 0);
+  munit_assert_uint32(query_cache_lookup(cache, 2, target, path), !=,
+                      QUERY_CACHE_MISS);
+  stats = query_cache_stats(cache);
+  munit_assert_uint64(stats.trees_built, ==, 1);
+  munit_assert_uint64(stats.tree_hits, ==, 1);
+
+  // Entries are evicted to keep the buckets inside the budget too
+  uint32_t pair[2] = {0, 1};
+  for (uint32_t i = 0; i < 200; i++) {
+    pair[0] = i;
+    query_cache_insert(cache, i, 0, pair, 2);
+    munit_assert_size(query_cache_stats(cache).pair_bytes, <=,
+                      options.pair_budget_bytes);
+  }
+  munit_assert_uint64(query_cache_stats(cache).pair_evictions, >, 0);
+
+  query_cache_destroy(cache);
+  graph_close(&graph);
+  return MUNIT_OK;
+}
+
+/* ====== Multi-source BFS Tests ====== */
+
+// Distances from source along out edges, or to it along in edges
+static void reference_distances(struct Graph* graph, uint32_t source,
+                                int reverse, uint32_t* distance) {
+  const uint32_t* offsets = reverse ? graph->in_offsets : graph->out_offsets;
+  const uint32_t* targets = reverse ? graph->in_targets : graph->out_targets;
+  uint32_t* queue = malloc(graph->node_count * sizeof(uint32_t));
+  for (uint32_t i = 0; i < graph->node_count; i++) {
+    distance[i] = UINT32_MAX;
+  }
+  uint32_t head = 0;
+  uint32_t tail = 0;
+  distance[source] = 0;
+  queue[tail++] = source;
+  while (head < tail) {
+    uint32_t node = queue[head++];
+    for (uint32_t i = offsets[node]; i < offsets[node + 1]; i++) {
+      if (distance[targets[i]] == UINT32_MAX) {
+        distance[targets[i]] = distance[node] + 1;
+        queue[tail++] = targets[i];
+      }
+    }
+  }
+  free(queue);
+}
+
+static MunitResult test_msbfs_matches_reference(const MunitParameter params[],
+                                                void* data) {
+  (void) params;
+  (void) data;
+
+  struct Graph graph;
+  open_synthetic_graph(&graph, 300, "./tmp_test_out/test_msbfs_graph");
+  // 70 sources leave most of the second word of lanes unused
+  uint32_t sources[70];
+  for (uint32_t i = 0; i < 70; i++) {
+    sources[i] = (i * 7919) % graph.node_count;
+  }
+  uint32_t* distance = malloc(graph.node_count * sizeof(uint32_t));
+  struct MsBfsResult* result = malloc(sizeof(struct MsBfsResult));
+
+  for (int reverse = 0; reverse < 2; reverse++) {
+    for (uint32_t threads = 1; threads <= 3; threads += 2) {
+      struct MsBfs msbfs = msbfs_init(&graph, 70, threads, reverse);
+      munit_assert_uint32(msbfs.words, ==, 2);
+      munit_assert_int(msbfs_run(&msbfs, sources, 70, result), ==, 0);
+
+      uint64_t histogram[SEARCH_MAX_PATH] = {0};
+      for (uint32_t i = 0; i < 70; i++) {
+        reference_distances(&graph, sources[i], reverse, distance);
+        uint32_t eccentricity = 0;
+        uint32_t reached = 0;
+        uint64_t distance_sum = 0;
+        for (uint32_t node = 0; node < graph.node_count; node++) {
+          if (distance[node] == UINT32_MAX) {
+            continue;
+          }
+          histogram[distance[node]]++;
+          reached++;
+          distance_sum += distance[node];
+          if (distance[node] > eccentricity) {
+            eccentricity = distance[node];
+          }
+        }
+        munit_assert_uint32(result->eccentricity[i], ==, eccentricity);
+        munit_assert_uint32(result->reached[i], ==, reached);
+        munit_assert_uint64(result->distance_sum[i], ==, distance_sum);
+        munit_assert_uint32(distance[result->farthest[i]], ==, eccentricity);
+      }
+      for (uint32_t d = 0; d < SEARCH_MAX_PATH; d++) {
+        munit_assert_uint64(result->histogram[d], ==, histogram[d]);
+      }
+      msbfs_destroy(&msbfs);
+    }
+  }
+
+  free(result);
+  free(distance);
+  graph_close(&graph);
+  return MUNIT_OK;
+}
+
+/* ====== Graph Reload Tests ====== */
+
+struct ReloadPoll {
+  struct GraphReloader* reloader;
+  int result;
+  atomic_int done;
+};
+
+static void* reload_poll_run(void* arg) {
+  struct ReloadPoll* poll = arg;
+  poll->result = graph_reloader_poll(poll->reloader);
+  atomic_store(&poll->done, 1);
+  return NULL;
+}
+
+static MunitResult test_graph_reload_generations(const MunitParameter params[],
+                                                 void* data) {
+  (void) params;
+  (void) data;
+
+  // Both stay mapped as references after their files are renamed away. The
+  // page added to the second sorts first, so every id moves.
+  struct Graph first;
+  struct Graph second;
+  open_synthetic_graph(&first, 300, "./tmp_test_out/test_reload_first");
+  open_synthetic_graph_with(
+      &second, 300,
+      "<page><title>!Reload</title><text>[[!Reload target]]</text></page>\n",
+      "./tmp_test_out/test_reload_second");
+  munit_assert_uint32(second.node_count, ==, first.node_count + 2);
+  const char* path = "./tmp_test_out/test_reload_graph";
+  munit_assert_int(rename("./tmp_test_out/test_reload_first", path), ==, 0);
+
+  struct GraphLoadOptions options = graph_load_default_options();
+  struct GraphReloader* reloader = graph_reloader_init(path, &options);
+  munit_assert_not_null(reloader);
+  uint32_t old_reader = graph_reloader_register(reloader);
+  uint32_t new_reader = graph_reloader_register(reloader);
+  const struct GraphGeneration* old =
+      graph_reloader_enter(reloader, old_reader);
+  munit_assert_uint64(old->number, ==, 1);
+  munit_assert_uint32(old->graph.node_count, ==, first.node_count);
+
+  struct QueryCacheOptions cache_options = query_cache_default_options();
+  cache_options.tree_admit_after = UINT32_MAX;
+  struct QueryCache* cache = query_cache_init(&old->graph, &cache_options);
+  struct SearchState state = search_state_init(&old->graph);
+  uint32_t path_nodes[SEARCH_MAX_PATH];
+  for (uint32_t i = 0; i < 200; i++) {
+    uint32_t source = (i * 7919) % old->graph.node_count;
+    uint32_t target = (i * 104729 + 13) % old->graph.node_count;
+    uint32_t length = search_shortest_path(&old->graph, &state, source,
+                                           target, path_nodes);
+    query_cache_insert(cache, source, target, path_nodes, length);
+  }
+  search_state_destroy(&state);
+
+  munit_assert_int(graph_reloader_poll(reloader), ==, 0);
+  munit_assert_int(rename("./tmp_test_out/test_reload_second", path), ==, 0);
+  // The first poll after a change only notes it
+  munit_assert_int(graph_reloader_poll(reloader), ==, 0);
+
+  // Publishing has to wait for the reader still in the first generation
+  struct ReloadPoll poll = {.reloader = reloader};
+  pthread_t thread;
+  pthread_create(&thread, NULL, reload_poll_run, &poll);
+  const struct GraphGeneration* next = NULL;
+  for (uint32_t tries = 0; tries < 5000; tries++) {
+    next = graph_reloader_enter(reloader, new_reader);
+    if (next->number == 2) {
+      break;
+    }
+    graph_reloader_exit(reloader, new_reader);
+    usleep(1000);
+  }
+  munit_assert_uint64(next->number, ==, 2);
+  munit_assert_uint32(next->graph.node_count, ==, second.node_count);
+  usleep(20000);
+  munit_assert_int(atomic_load(&poll.done), ==, 0);
+  // Still mapped
+  char scratch[TITLE_MAX_LENGTH];
+  struct Str title = interner_view_get(&old->graph.titles, 0, scratch);
+  munit_assert_uint32(
+      interner_view_find(&first.titles, title.data, title.length), ==, 0);
+  graph_reloader_exit(reloader, old_reader);
+  pthread_join(thread, NULL);
+  munit_assert_int(poll.result, ==, 1);
+
+  // Ids carried over by title
+  uint32_t carried = 0;
+  for (uint32_t i = 0; i < first.node_count; i++) {
+    title = interner_view_get(&first.titles, i, scratch);
+    munit_assert_uint32(
+        next->previous_ids[i], ==,
+        interner_view_find(&second.titles, title.data, title.length));
+    carried += next->previous_ids[i] != UINT32_MAX;
+  }
+  munit_assert_uint32(carried, >, 0);
+
+  // Translated paths are paths of the new graph
+  cache = query_cache_translate(cache, &next->graph, next->previous_ids);
+  uint32_t hits = 0;
+  for (uint32_t i = 0; i < 200; i++) {
+    uint32_t source = next->previous_ids[(i * 7919) % first.node_count];
+    uint32_t target =
+        next->previous_ids[(i * 104729 + 13) % first.node_count];
+    if (source == UINT32_MAX || target == UINT32_MAX) {
+      continue;
+    }
+    uint32_t length = query_cache_lookup(cache, source, target, path_nodes);
+    if (length == QUERY_CACHE_MISS) {
+      continue;
+    }
+    hits++;
+    munit_assert_uint32(length, >, 0);
+    munit_assert_uint32(path_nodes[0], ==, source);
+    munit_assert_uint32(path_nodes[length - 1], ==, target);
+    for (uint32_t j = 0; j + 1 < length; j++) {
+      munit_assert_uint32(
+          reference_distance(&second, path_nodes[j], path_nodes[j + 1]), ==,
+          1);
+    }
+  }
+  munit_assert_uint32(hits, >, 0);
+  graph_reloader_exit(reloader, new_reader);
+
+  query_cache_destroy(cache);
+  graph_reloader_destroy(reloader);
+  graph_close(&first);
+  graph_close(&second);
+  return MUNIT_OK;
+}
+
+// Calls past the limit fail without using up slots
+static MunitResult test_graph_reload_reader_limit(
+    const MunitParameter params[], void* data) {
+  (void) params;
+  (void) data;
+
+  struct Graph graph;
+  const char* path = "./tmp_test_out/test_reload_reader_limit";
+  open_synthetic_graph(&graph, 50, (char*) path);
+  struct GraphLoadOptions options = graph_load_default_options();
+  struct GraphReloader* reloader = graph_reloader_init(path, &options);
+  munit_assert_not_null(reloader);
+  for (uint32_t i = 0; i < RELOAD_MAX_READERS; i++) {
+    munit_assert_uint32(graph_reloader_register(reloader), ==, i);
+  }
+  for (uint32_t i = 0; i < 3; i++) {
+    munit_assert_uint32(graph_reloader_register(reloader), ==, UINT32_MAX);
+  }
+
+  // Publishing walks every registered slot, all of them idle here
+  struct Graph next_graph;
+  open_synthetic_graph(&next_graph, 60,
+                       "./tmp_test_out/test_reload_reader_limit_next");
+  munit_assert_int(
+      rename("./tmp_test_out/test_reload_reader_limit_next", path), ==, 0);
+  munit_assert_int(graph_reloader_poll(reloader), ==, 0);
+  munit_assert_int(graph_reloader_poll(reloader), ==, 1);
+  const struct GraphGeneration* generation =
+      graph_reloader_enter(reloader, RELOAD_MAX_READERS - 1);
+  munit_assert_uint64(generation->number, ==, 2);
+  graph_reloader_exit(reloader, RELOAD_MAX_READERS - 1);
+
+  graph_reloader_destroy(reloader);
+  graph_close(&graph);
+  graph_close(&next_graph);
+  return MUNIT_OK;
+}
+
+/* ====== Distributed Search Tests ====== */
+
+static void assert_distributed_matches(struct Graph* graph, const char* prefix,
+                                       uint32_t shard_count,
+                                       enum TransportKind kind) {
+  struct DistributedSearch search;
+  munit_assert_int(distributed_search_init(&search, prefix, shard_count, kind),
+                   ==, 0);
+  uint32_t path[SEARCH_MAX_PATH];
+  for (uint32_t i = 0; i < 100; i++) {
+    uint32_t source = (i * 7919) % graph->node_count;
+    uint32_t target = (i * 104729 + 13) % graph->node_count;
+    uint32_t expected = reference_distance(graph, source, target);
+    uint32_t length =
+        distributed_shortest_path(&search, source, target, path);
+    munit_assert_uint32(length, ==,
+                        expected == UINT32_MAX ? 0 : expected + 1);
+    if (length > 0) {
+      munit_assert_uint32(path[0], ==, source);
+      munit_assert_uint32(path[length - 1], ==, target);
+    }
+    for (uint32_t j = 0; j + 1 < length; j++) {
+      munit_assert_uint32(reference_distance(graph, path[j], path[j + 1]), ==,
+                          1);
+    }
+  }
+  distributed_search_destroy(&search);
+}
+
+static MunitResult test_distributed_matches_reference(
+    const MunitParameter params[], void* data) {
+  (void) params;
+  (void) data;
+
+  struct Graph graph;
+  open_synthetic_graph(&graph, 300, "./tmp_test_out/test_distributed_graph");
+  munit_assert_int(partition_graph(&graph, "./tmp_test_out/test_range", 3,
+                                   PARTITION_RANGE),
+                   ==, 0);
+  munit_assert_int(partition_graph(&graph, "./tmp_test_out/test_greedy", 4,
+                                   PARTITION_GREEDY),
+                   ==, 0);
+
+  // Every node is owned by exactly one shard
+  uint32_t owned = 0;
+  for (uint32_t i = 0; i < 4; i++) {
+    struct Shard shard;
+    munit_assert_int(shard_open(&shard, "./tmp_test_out/test_greedy", i), ==,
+                     0);
+    for (uint32_t j = 0; j < shard.local_node_count; j++) {
+      munit_assert_uint32(shard.owners[shard.nodes[j]], ==, i);
+      munit_assert_uint32(shard.local_ids[shard.nodes[j]], ==, j);
+    }
+    owned += shard.local_node_count;
+    shard_close(&shard);
+  }
+  munit_assert_uint32(owned, ==, graph.node_count);
+
+  assert_distributed_matches(&graph, "./tmp_test_out/test_range", 3,
+                             TRANSPORT_UNIX_SOCKET);
+  assert_distributed_matches(&graph, "./tmp_test_out/test_greedy", 4,
+                             TRANSPORT_SHARED_MEMORY);
+  graph_close(&graph);
+  return MUNIT_OK;
+}
+
+// A peer that exits without a word fails the other end instead of hanging it
+static MunitResult test_distributed_dead_peer(const MunitParameter params[],
+                                              void* data) {
+  (void) params;
+  (void) data;
+
+  enum TransportKind kinds[] = {TRANSPORT_UNIX_SOCKET,
+                                TRANSPORT_SHARED_MEMORY};
+  for (uint32_t i = 0; i < 2; i++) {
+    struct Transport coordinator_end;
+    struct Transport server_end;
+    munit_assert_int(transport_pair(kinds[i], &coordinator_end, &server_end),
+                     ==, 0);
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid == 0) {
+      _exit(0);
+    }
+    transport_close(&server_end);
+    transport_watch(&coordinator_end, pid);
+
+    struct ShardMessage message;
+    const struct Edge* edges;
+    munit_assert_int(transport_recv(&coordinator_end, &message, &edges), ==,
+                     1);
+    munit_assert_int(transport_recv(&coordinator_end, &message, &edges), ==,
+                     1);
+    transport_close(&coordinator_end);
+    waitpid(pid, NULL, 0);
+  }
+  return MUNIT_OK;
+}
+
+/* ====== Concurrent Interner Tests ====== */
+
+#define STRESS_THREADS 4
+#define STRESS_STRINGS 5000
+
+struct StressWorker {
+  struct ConcurrentInterner* interner;
+  uint32_t offset;
+  uint32_t ids[STRESS_STRINGS];
+};
+
+static void stress_string(uint32_t i, char* out) {
+  snprintf(out, 32, "Title %u", i);
+}
+
+// Every worker interns all the strings, starting at a different offset so the
+// threads race to add each one first
+static void* stress_worker_run(void* arg) {
+  struct StressWorker* worker = arg;
+  struct InternerLocal local = interner_local_init(worker->interner);
+  char buf[32];
+  for (uint32_t n = 0; n < STRESS_STRINGS; n++) {
+    uint32_t i = (n + worker->offset) % STRESS_STRINGS;
+    stress_string(i, buf);
+    worker->ids[i] = concurrent_intern(&local, buf, strlen(buf));
+    struct Str stored = concurrent_interner_get(worker->interner,
+                                                worker->ids[i]);
+    munit_assert_string_equal(stored.data, buf);
+  }
+  return NULL;
+}
+
+static MunitResult test_concurrent_interner_stress(const MunitParameter params[],
+                                                   void* data) {
+  (void) params;
+  (void) data;
+
+  // Start small so the shards grow while the threads run
+  struct ConcurrentInterner* interner = concurrent_interner_init(16);
+  static struct StressWorker workers[STRESS_THREADS];
+  pthread_t threads[STRESS_THREADS];
+  for (uint32_t t = 0; t < STRESS_THREADS; t++) {
+    workers[t].interner = interner;
+    workers[t].offset = t * STRESS_STRINGS / STRESS_THREADS;
+    pthread_create(&threads[t], NULL, stress_worker_run, &workers[t]);
+  }
+  for (uint32_t t = 0; t < STRESS_THREADS; t++) {
+    pthread_join(threads[t], NULL);
+  }
+
+  // Each string got exactly one id, the same one in every thread
+  munit_assert_uint32(concurrent_interner_length(interner), ==,
+                      STRESS_STRINGS);
+  char buf[32];
+  for (uint32_t i = 0; i < STRESS_STRINGS; i++) {
+    for (uint32_t t = 1; t < STRESS_THREADS; t++) {
+      munit_assert_uint32(workers[t].ids[i], ==, workers[0].ids[i]);
+    }
+    stress_string(i, buf);
+    struct Str stored = concurrent_interner_get(interner, workers[0].ids[i]);
+    munit_assert_uint32(stored.length, ==, strlen(buf));
+    munit_assert_string_equal(stored.data, buf);
+  }
+
+  concurrent_interner_destroy(interner);
+  return MUNIT_OK;
+}
+
 /* Test suite definition */
 static MunitTest test_suite_tests[] = {
     {(char*) "/interner/single_string", test_interner_single_string, NULL, NULL,
@@ -509,6 +1944,13 @@ static MunitTest test_suite_tests[] = {
     {(char*) "/parser/links_multiple_complete",
      test_parse_links_multiple_complete, NULL, NULL, MUNIT_TEST_OPTION_NONE,
      NULL},
+    {(char*) "/parser/links_with_limits", test_parse_links_with_limits, NULL,
+     NULL, MUNIT_TEST_OPTION_NONE, NULL},
+    {(char*) "/parser/buffer_text_without_links",
+     test_parse_buffer_text_without_links, NULL, NULL, MUNIT_TEST_OPTION_NONE,
+     NULL},
+    {(char*) "/parser/buffer_empty_text", test_parse_buffer_empty_text, NULL,
+     NULL, MUNIT_TEST_OPTION_NONE, NULL},
     {(char*) "/parser/buffer_title_tag", test_parse_buffer_title_tag, NULL,
      NULL, MUNIT_TEST_OPTION_NONE, NULL},
     {(char*) "/parser/title_across_buffers", test_parse_title_across_buffers,
@@ -517,6 +1959,47 @@ static MunitTest test_suite_tests[] = {
      NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
     {(char*) "/integration/simple_case", test_integration_simple_case, NULL,
      NULL, MUNIT_TEST_OPTION_NONE, NULL},
+    {(char*) "/integration/multiple_pages", test_integration_multiple_pages,
+     NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
+    {(char*) "/graph/write_and_open", test_graph_write_and_open, NULL, NULL,
+     MUNIT_TEST_OPTION_NONE, NULL},
+    {(char*) "/graph/long_titles", test_graph_long_titles, NULL, NULL,
+     MUNIT_TEST_OPTION_NONE, NULL},
+    {(char*) "/graph/front_coded", test_graph_front_coded, NULL, NULL,
+     MUNIT_TEST_OPTION_NONE, NULL},
+    {(char*) "/scc/tarjan", test_scc_tarjan, NULL, NULL,
+     MUNIT_TEST_OPTION_NONE, NULL},
+    {(char*) "/search/shortest_path", test_search_shortest_path, NULL, NULL,
+     MUNIT_TEST_OPTION_NONE, NULL},
+    {(char*) "/search/matches_reference", test_search_matches_reference, NULL,
+     NULL, MUNIT_TEST_OPTION_NONE, NULL},
+    {(char*) "/search/constraints", test_search_constraints, NULL, NULL,
+     MUNIT_TEST_OPTION_NONE, NULL},
+    {(char*) "/labels/match_reference", test_labels_match_reference, NULL,
+     NULL, MUNIT_TEST_OPTION_NONE, NULL},
+    {(char*) "/graph/load_options", test_graph_load_options, NULL, NULL,
+     MUNIT_TEST_OPTION_NONE, NULL},
+    {(char*) "/cache/matches_search", test_query_cache_matches_search, NULL,
+     NULL, MUNIT_TEST_OPTION_NONE, NULL},
+    {(char*) "/cache/deferred_trees", test_query_cache_deferred_trees, NULL,
+     NULL, MUNIT_TEST_OPTION_NONE, NULL},
+    {(char*) "/msbfs/matches_reference", test_msbfs_matches_reference, NULL,
+     NULL, MUNIT_TEST_OPTION_NONE, NULL},
+    {(char*) "/reload/generations", test_graph_reload_generations, NULL, NULL,
+     MUNIT_TEST_OPTION_NONE, NULL},
+    {(char*) "/reload/reader_limit", test_graph_reload_reader_limit, NULL,
+     NULL, MUNIT_TEST_OPTION_NONE, NULL},
+    {(char*) "/distributed/matches_reference",
+     test_distributed_matches_reference, NULL, NULL, MUNIT_TEST_OPTION_NONE,
+     NULL},
+    {(char*) "/distributed/dead_peer", test_distributed_dead_peer, NULL, NULL,
+     MUNIT_TEST_OPTION_NONE, NULL},
+    {(char*) "/concurrent_interner/stress", test_concurrent_interner_stress,
+     NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
+    {(char*) "/synth/deterministic", test_synth_dump_deterministic, NULL, NULL,
+     MUNIT_TEST_OPTION_NONE, NULL},
+    {(char*) "/synth/small_buffers", test_synth_small_buffers, NULL, NULL,
+     MUNIT_TEST_OPTION_NONE, NULL},
     {NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL}};
 
 static const MunitSuite test_suite = {(char*) "/wiki_racer_tests",
@@ -525,5 +2008,6 @@ static const MunitSuite test_suite = {(char*) "/wiki_racer_tests",
 
 int main(int argc, char* argv[MUNIT_ARRAY_PARAM(argc + 1)]) {
   set_log_level(LOG_LEVEL_INFO);
+  mkdir("tmp_test_out", 0755);
   return munit_suite_main(&test_suite, (void*) "wiki_racer", argc, argv);
 }